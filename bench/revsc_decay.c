@@ -0,0 +1,114 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* CPU time of sp_revsc during a 30 second decay after 1 second of noise, in
+   windows of 5 seconds, with and without the protection against subnormal
+   floats. "none" clears sp_revsc.antiDenormal and runs with FTZ/DAZ off,
+   "offset" is the kernel's alternating offset alone, "ftz" is FTZ/DAZ alone
+   as set by the plugin. Without either, the windows where the tail reaches
+   subnormal levels take several times longer. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define HAVE_FTZ
+#endif
+#include "soundpipe.h"
+
+#define SRATE   48000
+#define BLOCK   256
+#define WINDOW  5
+#define DECAY   30
+
+enum { MODE_NONE, MODE_OFFSET, MODE_FTZ };
+
+static const char *modeNames[] = { "none", "offset", "ftz" };
+
+static void set_ftz(int on)
+{
+#ifdef HAVE_FTZ
+    /* -ffast-math may have set FTZ/DAZ at startup */
+    _mm_setcsr(on ? (_mm_getcsr() | 0x8040) : (_mm_getcsr() & ~0x8040));
+#endif
+}
+
+static double cpu_ms(void)
+{
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static void run(int mode)
+{
+    static SPFLOAT noise[BLOCK], silence[BLOCK], out1[BLOCK], out2[BLOCK];
+    sp_data *sp;
+    sp_revsc *p;
+    uint32_t seed = 1;
+    double start;
+    int i, b, t;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    sp_revsc_init(sp, p);
+    p->feedback = 0.6;
+    p->lpfreq = 4000;
+    if (mode != MODE_OFFSET) p->antiDenormal = 0;
+    set_ftz(mode == MODE_FTZ);
+
+    for (i = 0; i < BLOCK; i++) {
+        seed = seed * 1664525 + 1013904223;
+        noise[i] = (SPFLOAT) (seed >> 8) / 16777216 - 0.5;
+        silence[i] = 0;
+    }
+    for (b = 0; b < SRATE / BLOCK; b++) {
+        sp_revsc_compute_block(sp, p, noise, noise, out1, out2, BLOCK);
+    }
+
+    printf("%-6s", modeNames[mode]);
+    for (t = 0; t < DECAY; t += WINDOW) {
+        start = cpu_ms();
+        for (b = 0; b < WINDOW * SRATE / BLOCK; b++) {
+            sp_revsc_compute_block(sp, p, silence, silence, out1, out2, BLOCK);
+        }
+        printf(" %7.1f", cpu_ms() - start);
+    }
+    printf("\n");
+
+    set_ftz(0);
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(void)
+{
+    int t;
+
+    printf("CPU ms per %d s window of a %d s decay at %d Hz\n", WINDOW, DECAY, SRATE);
+    printf("%-6s", "mode");
+    for (t = 0; t < DECAY; t += WINDOW) printf("   %2d-%2ds", t, t + WINDOW);
+    printf("\n");
+
+    run(MODE_NONE);
+    run(MODE_OFFSET);
+#ifdef HAVE_FTZ
+    run(MODE_FTZ);
+#endif
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CPU time of sp_revsc with float and 16 bit storage against sp_revsc_fixed
+// with Q31 and Q15 storage, for the same 1 second of noise at -18 dBFS
+// followed by a 4 second tail, at the interpolation and pitch modulation of
+// each plugin Quality. The SNR columns compare sp_revsc_fixed with float
+// sp_revsc, eco has no pitch modulation and reads whole samples so only the
+// arithmetic differs there.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+#include "soundpipe.h"
+}
+
+#define SRATE   48000
+#define BLOCK   256
+#define SECONDS 5
+
+struct Quality
+{
+    const char* name;
+    int         interpolation;
+    SPFLOAT     pitchMod;
+};
+
+static const Quality qualities[] = {
+    { "eco",    SP_REVSC_NONE,   0 },
+    { "normal", SP_REVSC_LINEAR, 1 },
+    { "high",   SP_REVSC_CUBIC,  1 }
+};
+
+static const int frames = SRATE * SECONDS;
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double run_float(const Quality& q, int storage, const std::vector<float>& in,
+                        std::vector<float>& out)
+{
+    std::vector<float> l(in), r(in);
+    sp_data* sp;
+    sp_revsc* p;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    p->iStorage = storage;
+    sp_revsc_init(sp, p);
+    p->feedback = 0.97;
+    p->lpfreq = 10000;
+    p->interpolation = q.interpolation;
+    p->iPitchMod = q.pitchMod;
+    sp_revsc_reset(sp, p);
+
+    out.resize(2 * frames);
+    double start = now_ms();
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        sp_revsc_compute_block(sp, p, &l[i], &r[i], &out[i], &out[frames + i], n);
+    }
+    double ms = now_ms() - start;
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+    return ms;
+}
+
+static double run_fixed(const Quality& q, int storage, const std::vector<int32_t>& in,
+                        std::vector<int32_t>& out)
+{
+    std::vector<int32_t> l(in), r(in);
+    sp_data* sp;
+    sp_revsc_fixed* p;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_fixed_create(&p);
+    p->iStorage = storage;
+    p->iPitchMod = (int) (q.pitchMod * 32768);
+    sp_revsc_fixed_init(sp, p);
+    p->feedback = 0.97;
+    p->lpfreq = 10000;
+    p->interpolation = q.interpolation;
+
+    out.resize(2 * frames);
+    double start = now_ms();
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        sp_revsc_fixed_compute_block(sp, p, &l[i], &r[i], &out[i], &out[frames + i], n);
+    }
+    double ms = now_ms() - start;
+
+    sp_revsc_fixed_destroy(&p);
+    sp_destroy(&sp);
+    return ms;
+}
+
+static double snr(const std::vector<float>& ref, const std::vector<int32_t>& x)
+{
+    double sig = 0, err = 0;
+
+    for (size_t i = 0; i < ref.size(); i++) {
+        double e = x[i] / 2147483648.0 - ref[i];
+        sig += (double) ref[i] * ref[i];
+        err += e * e;
+    }
+    return err > 0 ? 10 * std::log10(sig / err) : INFINITY;
+}
+
+int main()
+{
+    std::vector<int32_t> in(frames, 0), outQ31, outQ15;
+    std::vector<float> inF(frames), outF, outI;
+    uint32_t seed = 1;
+
+    for (int i = 0; i < SRATE; i++) {
+        seed = seed * 1664525 + 1013904223;
+        in[i] = (int32_t) (seed & 0xffffff00) >> 3;
+    }
+    for (int i = 0; i < frames; i++) {
+        inF[i] = (float) (in[i] / 2147483648.0);
+    }
+
+    printf("ms for %d s at %d Hz, SNR in dB against float sp_revsc\n", SECONDS, SRATE);
+    printf("%-7s %8s %8s %8s %8s %8s %8s\n", "quality", "float", "int16", "Q31", "Q15",
+           "Q31 SNR", "Q15 SNR");
+
+    for (const Quality& q : qualities) {
+        double f = run_float(q, SP_REVSC_FLOAT, inF, outF);
+        double i16 = run_float(q, SP_REVSC_INT16, inF, outI);
+        double q31 = run_fixed(q, SP_REVSC_Q31, in, outQ31);
+        double q15 = run_fixed(q, SP_REVSC_Q15, in, outQ15);
+
+        printf("%-7s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", q.name, f, i16, q31, q15,
+               snr(outF, outQ31), snr(outF, outQ15));
+    }
+
+    return 0;
+}
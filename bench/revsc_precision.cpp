@@ -0,0 +1,141 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CPU time of sp_revsc, RevSC<float> and RevSC<double> for the same 1 second
+// of noise followed by a 4 second tail, at the interpolation and pitch
+// modulation of each plugin Quality. The SNR columns compare the output of
+// each RevSC with sp_revsc, read positions are the same so the difference is
+// the arithmetic alone.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "RevSC.hpp"
+
+#define SRATE   48000
+#define BLOCK   256
+#define SECONDS 5
+
+struct Quality
+{
+    const char* name;
+    int         interpolation;
+    SPFLOAT     pitchMod;
+};
+
+static const Quality qualities[] = {
+    { "eco",    SP_REVSC_NONE,   0 },
+    { "normal", SP_REVSC_LINEAR, 1 },
+    { "high",   SP_REVSC_CUBIC,  1 }
+};
+
+static const int frames = SRATE * SECONDS;
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double run_c(const Quality& q, const std::vector<float>& in, std::vector<float>& out)
+{
+    std::vector<float> l(in), r(in);
+    sp_data* sp;
+    sp_revsc* p;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    sp_revsc_init(sp, p);
+    p->feedback = 0.97;
+    p->lpfreq = 10000;
+    p->interpolation = q.interpolation;
+    p->iPitchMod = q.pitchMod;
+    sp_revsc_reset(sp, p);
+
+    out.resize(2 * frames);
+    double start = now_ms();
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        sp_revsc_compute_block(sp, p, &l[i], &r[i], &out[i], &out[frames + i], n);
+    }
+    double ms = now_ms() - start;
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+    return ms;
+}
+
+template <typename Sample>
+static double run_cpp(const Quality& q, const std::vector<float>& in, std::vector<float>& out)
+{
+    RevSC<Sample> rev;
+
+    rev.feedback = Sample(0.97);
+    rev.lpfreq = Sample(10000);
+    rev.interpolation = q.interpolation;
+    rev.pitchMod = q.pitchMod;
+    rev.init(SRATE, SRATE);
+
+    out.resize(2 * frames);
+    double start = now_ms();
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        rev.process(&in[i], &in[i], &out[i], &out[frames + i], n);
+    }
+    return now_ms() - start;
+}
+
+static double snr(const std::vector<float>& ref, const std::vector<float>& x)
+{
+    double sig = 0, err = 0;
+
+    for (size_t i = 0; i < ref.size(); i++) {
+        sig += (double) ref[i] * ref[i];
+        err += ((double) x[i] - ref[i]) * ((double) x[i] - ref[i]);
+    }
+    return err > 0 ? 10 * std::log10(sig / err) : INFINITY;
+}
+
+int main()
+{
+    std::vector<float> in(frames, 0.f), outC, outF, outD;
+    uint32_t seed = 1;
+
+    for (int i = 0; i < SRATE; i++) {
+        seed = seed * 1664525 + 1013904223;
+        in[i] = (float) (seed >> 8) / 16777216 - 0.5f;
+    }
+
+    printf("ms for %d s at %d Hz, SNR in dB against sp_revsc\n", SECONDS, SRATE);
+    printf("%-7s %8s %8s %8s %10s %10s\n", "quality", "C", "float", "double", "float SNR", "double SNR");
+
+    for (const Quality& q : qualities) {
+        double c = run_c(q, in, outC);
+        double f = run_cpp<float>(q, in, outF);
+        double d = run_cpp<double>(q, in, outD);
+
+        printf("%-7s %8.1f %8.1f %8.1f %10.1f %10.1f\n", q.name, c, f, d,
+               snr(outC, outF), snr(outC, outD));
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Cache misses and wall clock time of a single sp_revsc and of a bank of 16,
+   with the prefetch distance set to 0 (off) and to a few frame counts around
+   SP_REVSC_PREFETCH. Misses are L1 data and last level cache read misses per
+   frame, counted with perf_event_open() on Linux. Where the counters are not
+   available (other systems, containers, perf_event_paranoid) only the time
+   is reported. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_PERF
+#endif
+#include "soundpipe.h"
+
+#define BLOCK   256
+#define SECONDS 10
+#define MEMBERS 16
+
+enum { COUNT_L1D, COUNT_LL, COUNTERS };
+
+static const char *counterNames[COUNTERS] = { "L1D miss", "LL miss" };
+
+static const int distances[] = { 0, 16, 32, SP_REVSC_PREFETCH, 128 };
+
+static int counters[COUNTERS] = { -1, -1 };
+
+#ifdef HAVE_PERF
+static int open_counter(uint64_t cache)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void open_counters(void)
+{
+#ifdef HAVE_PERF
+    counters[COUNT_L1D] = open_counter(PERF_COUNT_HW_CACHE_L1D);
+    counters[COUNT_LL] = open_counter(PERF_COUNT_HW_CACHE_LL);
+#endif
+}
+
+static void start_counters(void)
+{
+#ifdef HAVE_PERF
+    int c;
+
+    for (c = 0; c < COUNTERS; c++) {
+        if (counters[c] < 0) continue;
+        ioctl(counters[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/* misses[c] is -1 if counter c is not available */
+
+static void stop_counters(long long *misses)
+{
+    int c;
+
+    for (c = 0; c < COUNTERS; c++) {
+        misses[c] = -1;
+#ifdef HAVE_PERF
+        if (counters[c] < 0) continue;
+        ioctl(counters[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counters[c], &misses[c], sizeof(misses[c])) != sizeof(misses[c]))
+            misses[c] = -1;
+#endif
+    }
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void report(const char *name, int sr, int prefetch, double ms, const long long *misses)
+{
+    long frames = (long) sr * SECONDS;
+    int c;
+
+    printf("%-6s %6d %8d %9.1f", name, sr, prefetch, ms);
+    for (c = 0; c < COUNTERS; c++) {
+        if (misses[c] < 0) printf(" %12s", "n/a");
+        else printf(" %12.3f", (double) misses[c] / frames);
+    }
+    printf("\n");
+}
+
+static void fill_noise(SPFLOAT *buf, int n)
+{
+    static uint32_t seed = 1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        seed = seed * 1664525 + 1013904223;
+        buf[i] = (SPFLOAT) (seed >> 8) / 16777216 - 0.5;
+    }
+}
+
+static void run_single(int sr, int prefetch)
+{
+    static SPFLOAT in[BLOCK], out1[BLOCK], out2[BLOCK];
+    long long misses[COUNTERS];
+    sp_data *sp;
+    sp_revsc *p;
+    double start;
+    int b;
+
+    sp_create(&sp);
+    sp->sr = sr;
+    sp_revsc_create(&p);
+    p->prefetch = prefetch;
+    sp_revsc_init(sp, p);
+    fill_noise(in, BLOCK);
+
+    /* first pass over the delay memory, not measured */
+    for (b = 0; b < 4 * sr / BLOCK; b++) {
+        sp_revsc_compute_block(sp, p, in, in, out1, out2, BLOCK);
+    }
+
+    start_counters();
+    start = now_ms();
+    for (b = 0; b < SECONDS * sr / BLOCK; b++) {
+        sp_revsc_compute_block(sp, p, in, in, out1, out2, BLOCK);
+    }
+    start = now_ms() - start;
+    stop_counters(misses);
+    report("single", sr, prefetch, start, misses);
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+static void run_bank(int sr, int prefetch)
+{
+    static SPFLOAT buf[3][MEMBERS][BLOCK];
+    SPFLOAT *in[MEMBERS], *out1[MEMBERS], *out2[MEMBERS];
+    long long misses[COUNTERS];
+    sp_data *sp;
+    sp_revsc_bank *p;
+    double start;
+    int b, m;
+
+    sp_create(&sp);
+    sp->sr = sr;
+    sp_revsc_bank_create(&p, MEMBERS);
+    p->prefetch = prefetch;
+    sp_revsc_bank_init(sp, p);
+    for (m = 0; m < MEMBERS; m++) {
+        fill_noise(buf[0][m], BLOCK);
+        in[m] = buf[0][m];
+        out1[m] = buf[1][m];
+        out2[m] = buf[2][m];
+    }
+
+    for (b = 0; b < 4 * sr / BLOCK; b++) {
+        sp_revsc_bank_compute_block(sp, p, in, in, out1, out2, BLOCK);
+    }
+
+    start_counters();
+    start = now_ms();
+    for (b = 0; b < SECONDS * sr / BLOCK; b++) {
+        sp_revsc_bank_compute_block(sp, p, in, in, out1, out2, BLOCK);
+    }
+    start = now_ms() - start;
+    stop_counters(misses);
+    report("bank", sr, prefetch, start, misses);
+
+    sp_revsc_bank_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(void)
+{
+    static const int rates[] = { 48000, 192000 };
+    size_t d, r;
+    int c;
+
+    open_counters();
+    if (counters[COUNT_L1D] < 0 && counters[COUNT_LL] < 0) {
+        printf("cache counters not available, reporting time only\n");
+    }
+
+    printf("ms for %d s, misses per frame, bank of %d members\n", SECONDS, MEMBERS);
+    printf("%-6s %6s %8s %9s", "kind", "rate", "prefetch", "ms");
+    for (c = 0; c < COUNTERS; c++) printf(" %12s", counterNames[c]);
+    printf("\n");
+
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+            run_single(rates[r], distances[d]);
+        }
+    }
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+            run_bank(rates[r], distances[d]);
+        }
+    }
+    return 0;
+}
@@ -16,8 +16,20 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+# include <xmmintrin.h>
+#endif
 
 #include "DistrhoPlugin.hpp"
 #include "DistrhoPluginInfo.h"
@@ -25,30 +37,250 @@
 extern "C" {
 #include "dsp/soundpipe.h"
 }
+#include "dsp/Halfband.hpp"
+#include "dsp/RevSC.hpp"
 
 #define LOG_2     0.69314718056f
 #define LOG_400   5.99146454711f
 #define LOG_10000 9.21034037198f
 
+// Reverb stops computing once input and tail stay below this level (-120 dBFS)
+#define SILENCE_THRESHOLD 1e-6f
+
+// Blocks of at least this many frames are only seen in offline renders, the
+// "threads" state spreads them across the worker pool
+#define OFFLINE_FRAMES 8192
+
+// Delay memory is allocated once for this rate, lower rates reuse it
+#ifndef CASTELLO_MAX_SAMPLE_RATE
+#define CASTELLO_MAX_SAMPLE_RATE 192000
+#endif
+
 START_NAMESPACE_DISTRHO
 
+// Sets flush-to-zero and denormals-are-zero for the current thread while in
+// scope and restores the previous mode on exit
+
+class ScopedDenormalsDisable
+{
+public:
+    ScopedDenormalsDisable()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        fMode = _mm_getcsr();
+        _mm_setcsr(fMode | 0x8040); // FTZ | DAZ
+#elif defined(__aarch64__)
+        __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fMode));
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fMode | (1 << 24))); // FZ
+#endif
+    }
+
+    ~ScopedDenormalsDisable()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        _mm_setcsr(fMode);
+#elif defined(__aarch64__)
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fMode));
+#endif
+    }
+
+private:
+#if defined(__aarch64__)
+    uint64_t fMode;
+#else
+    unsigned int fMode;
+#endif
+
+};
+
+// Persistent threads that run the tasks of a call to run() together with the
+// calling thread. After a call workers spin for a while, so that the next one
+// does not pay for a wake up, and then sleep until there is work again.
+
+class WorkerPool
+{
+public:
+    typedef void (*Task)(void* arg, int index);
+
+    WorkerPool()
+        : fTask(0)
+        , fArg(0)
+        , fWork(0)
+        , fPending(0)
+        , fSleepers(0)
+        , fQuit(false)
+    {}
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fQuit = true;
+        }
+
+        fWake.notify_all();
+
+        for (size_t i = 0; i < fThreads.size(); ++i) {
+            fThreads[i].join();
+        }
+    }
+
+    // Not real-time safe
+    void start(int workers)
+    {
+        for (int i = 0; i < workers; ++i) {
+            fThreads.push_back(std::thread(&WorkerPool::work, this));
+        }
+    }
+
+    int size() const
+    {
+        return static_cast<int>(fThreads.size());
+    }
+
+    // Runs task(arg, i) for i from 0 to count - 1 and returns once all are done
+    void run(Task task, void* arg, int count)
+    {
+        const uint64_t gen = (fWork.load(std::memory_order_relaxed) >> 32) + 1;
+
+        fTask = task;
+        fArg = arg;
+        fPending.store(count, std::memory_order_relaxed);
+
+        // Generation in the upper half, the count and the next index in the
+        // lower one, so that workers can only take tasks of the current call
+        fWork.store((gen << 32) | (static_cast<uint64_t>(count) << 16));
+
+        if (fSleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fWake.notify_all();
+        }
+
+        take(gen);
+
+        while (fPending.load(std::memory_order_acquire) > 0) {
+            pause();
+        }
+    }
+
+private:
+    static const int kSpins = 1 << 14;
+
+    void take(uint64_t gen)
+    {
+        uint64_t work = fWork.load(std::memory_order_acquire);
+
+        while (((work >> 32) == gen) && ((work & 0xFFFF) < ((work >> 16) & 0xFFFF))) {
+            if (fWork.compare_exchange_weak(work, work + 1, std::memory_order_acq_rel)) {
+                fTask(fArg, static_cast<int>(work & 0xFFFF));
+                fPending.fetch_sub(1, std::memory_order_release);
+                work = fWork.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    void work()
+    {
+        // Same floating point mode as run(), output does not depend on the
+        // thread a task runs on
+        ScopedDenormalsDisable sdd;
+        uint64_t seen = 0;
+
+        for (;;) {
+            uint64_t gen = fWork.load(std::memory_order_acquire) >> 32;
+
+            for (int i = 0; (gen == seen) && (i < kSpins); ++i) {
+                pause();
+                gen = fWork.load(std::memory_order_acquire) >> 32;
+            }
+
+            if (gen == seen) {
+                std::unique_lock<std::mutex> lock(fMutex);
+
+                fSleepers.fetch_add(1);
+                fWake.wait(lock, [&] { return fQuit || ((fWork.load() >> 32) != seen); });
+                fSleepers.fetch_sub(1);
+
+                if (fQuit) {
+                    return;
+                }
+
+                continue;
+            }
+
+            seen = gen;
+            take(gen);
+        }
+    }
+
+    static void pause()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        _mm_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__ ("yield");
+#endif
+    }
+
+    std::vector<std::thread> fThreads;
+    Task                     fTask;
+    void*                    fArg;
+    std::atomic<uint64_t>    fWork;
+    std::atomic<int>         fPending;
+    std::atomic<int>         fSleepers;
+    std::mutex               fMutex;
+    std::condition_variable  fWake;
+    bool                     fQuit;
+
+};
+
 enum ParameterIndex {
     kParameterMix,
     kParameterSize,
-    kParameterBrightness
+    kParameterBrightness,
+    kParameterQuality,
+    kParameterCount
+};
+
+enum Quality {
+    kQualityEco,    // fixed delays read at whole samples
+    kQualityNormal, // modulated delays with linear interpolation
+    kQualityHigh    // modulated delays with cubic interpolation
 };
 
 class CastelloReverbPlugin : public Plugin
 {
 public:
     CastelloReverbPlugin()
-        : Plugin(3 /*parameters*/, 0 /*programs*/, 1 /*states*/)
+        : Plugin(kParameterCount /*parameters*/, 0 /*programs*/, 4 /*states*/)
         , fSoundpipe(0)
         , fReverb(0)
-        , fMix(0)
+        , fDry(1)
+        , fWet(1)
+        , fDryTarget(1)
+        , fWetTarget(1)
+        , fQuietFrames(0)
+        , fSleeping(false)
+        , fParameterSerial(0)
+        , fParameterSerialSeen(0)
+        , fDoublePrecision(false)
+        , fDoubleReady(false)
+        , fRunningDouble(false)
+        , fCarryFrames(0)
+        , fRateStages(0)
+        , fReduceRate(false)
+        , fRunningReduced(false)
+        , fOfflineThreads(false)
+        , fParallelReady(false)
     {
+        for (int i = 0; i < kParameterCount; ++i) {
+            fParameters[i].store(0, std::memory_order_relaxed);
+        }
+
         sp_create(&fSoundpipe);
+        fSoundpipe->sr = static_cast<int>(getSampleRate());
         sp_revsc_create(&fReverb);
+        fReverb->iMaxSampleRate = CASTELLO_MAX_SAMPLE_RATE;
         sp_revsc_init(fSoundpipe, fReverb);
     }
 
@@ -110,42 +342,55 @@ public:
             parameter.ranges.max = 1.f;
             parameter.ranges.def = 0.66f;
             break;
+        case kParameterQuality: {
+            // Not automatable, switching modes restarts the delay modulation
+            ParameterEnumerationValue* const values = new ParameterEnumerationValue[3];
+            values[0].label = "Eco";
+            values[0].value = kQualityEco;
+            values[1].label = "Normal";
+            values[1].value = kQualityNormal;
+            values[2].label = "High";
+            values[2].value = kQualityHigh;
+            parameter.hints = kParameterIsInteger;
+            parameter.name = "Quality";
+            parameter.symbol = "quality";
+            parameter.ranges.min = kQualityEco;
+            parameter.ranges.max = kQualityHigh;
+            parameter.ranges.def = kQualityHigh;
+            parameter.enumValues.count = 3;
+            parameter.enumValues.restrictedMode = true;
+            parameter.enumValues.values = values;
+            break;
+        }
         }
 
         setParameterValue(index, parameter.ranges.def);
     }
 
+    // Called from any thread, returns the value last set
     float getParameterValue(uint32_t index) const override
     {
-        switch (index)
-        {
-        case kParameterMix:
-            return fMix;
-        case kParameterSize:
-            return (fReverb->feedback - 0.5f) * 2.f;
-        case kParameterBrightness:
-            return (log(fReverb->lpfreq) - LOG_400) / (LOG_10000 - LOG_400);
+        if (index >= kParameterCount) {
+            return 0;
         }
 
-        return 0;
+        return fParameters[index].load(std::memory_order_relaxed);
     }
 
+    // Called from any thread, only publishes the value. The engine picks it
+    // up at the start of the next run(), see updateParameters().
     void setParameterValue(uint32_t index, float value) override
     {
-        switch (index)
-        {
-        case kParameterMix:
-            fMix = value;
-            fDry = fMix < 0.5f ? 1.f : 1.f - log(fMix / 0.5f) / LOG_2;
-            fWet = fMix > 0.5f ? 1.f : 1.f - log((1.f - fMix) / 0.5f) / LOG_2;
-            break;
-        case kParameterSize:
-            fReverb->feedback = 0.5f + value / 2.f;
-            break;
-        case kParameterBrightness:
-            fReverb->lpfreq = exp(LOG_400 + (LOG_10000 - LOG_400) * value);
-            break;
+        if (index >= kParameterCount) {
+            return;
+        }
+
+        if (index == kParameterQuality) {
+            value = static_cast<float>(static_cast<int>(value + 0.5f));
         }
+
+        fParameters[index].store(value, std::memory_order_relaxed);
+        fParameterSerial.fetch_add(1, std::memory_order_release);
     }
 
     void initState(uint32_t index, String& stateKey, String& defaultStateValue) override
@@ -154,15 +399,68 @@ public:
         {
         case 0:
             stateKey = "ui_size";
+            defaultStateValue = "";
+            break;
+        case 1:
+            // "double" renders the reverb in double precision, meant for
+            // final renders as it takes 2.5 to 4 times the CPU time of the
+            // default "single". Takes effect once the reverb tail has
+            // decayed, see switchPrecision().
+            stateKey = "precision";
+            defaultStateValue = "single";
+            break;
+        case 2:
+            // "reduced" runs the reverb at 44.1 or 48 kHz when the host rate
+            // is a multiple, the dry signal stays at the host rate. Takes
+            // effect once the reverb tail has decayed.
+            stateKey = "internal_rate";
+            defaultStateValue = "host";
+            break;
+        case 3:
+            // "offline" runs the delay lines on worker threads for blocks of
+            // OFFLINE_FRAMES or more. The reverb is time blocked throughout,
+            // so that output is the same bit for bit whether blocks run on
+            // workers or not, and within rounding of "single". Workers are
+            // started by setState(), never on the audio thread.
+            stateKey = "threads";
+            defaultStateValue = "single";
             break;
         }
-
-        defaultStateValue = "";
     }
 
     void setState(const char* key, const char* value) override
     {
         fState[key] = value;
+
+        // Flags are read by run() on the audio thread
+
+        if (std::strcmp(key, "precision") == 0) {
+            const bool doublePrecision = std::strcmp(value, "double") == 0;
+
+            // The double precision engine is allocated on first use, laid
+            // out at the internal rate requested by the "internal_rate"
+            // state. run() only touches it after fDoubleReady is set.
+            if (doublePrecision && !fDoubleReady.load(std::memory_order_acquire)) {
+                const bool reduceRate = fReduceRate.load(std::memory_order_acquire);
+                const int  stages = rateStages(getSampleRate(), reduceRate);
+
+                fReverbDouble.init(static_cast<int>(getSampleRate()) >> stages,
+                                   CASTELLO_MAX_SAMPLE_RATE, fReverb->iLines);
+                fDoubleReady.store(true, std::memory_order_release);
+            }
+
+            fDoublePrecision.store(doublePrecision, std::memory_order_release);
+        } else if (std::strcmp(key, "internal_rate") == 0) {
+            fReduceRate.store(std::strcmp(value, "reduced") == 0, std::memory_order_release);
+        } else if (std::strcmp(key, "threads") == 0) {
+            const bool offlineThreads = std::strcmp(value, "offline") == 0;
+
+            if (offlineThreads) {
+                startWorkers();
+            }
+
+            fOfflineThreads.store(offlineThreads, std::memory_order_release);
+        }
     }
 
     String getState(const char* key) const override
@@ -176,6 +474,54 @@ public:
         return String(it->second.c_str());
     }
 
+    void activate() override
+    {
+        if (fParallelReady.load(std::memory_order_acquire)) {
+            resizeParallelBuffers(getBufferSize());
+        }
+
+        updateParameters(true);
+        setInternalRate(getSampleRate(), true);
+
+        // No ramp from the gains before deactivation
+        fDry = fDryTarget;
+        fWet = fWetTarget;
+
+        // Delay lines are clear, nothing to compute until there is input
+        fSleeping = true;
+    }
+
+    void bufferSizeChanged(uint32_t newBufferSize) override
+    {
+        if (fParallelReady.load(std::memory_order_acquire)) {
+            resizeParallelBuffers(newBufferSize);
+        }
+    }
+
+    void sampleRateChanged(double newSampleRate) override
+    {
+        fSoundpipe->sr = static_cast<int>(newSampleRate);
+
+        if (fDoubleReady.load(std::memory_order_acquire)
+                && !fReverbDouble.reset(newSampleRate)) {
+            fReverbDouble.init(newSampleRate, newSampleRate, fReverb->iLines);
+        }
+
+        if (sp_revsc_reset(fSoundpipe, fReverb) != SP_OK) {
+            // Rate is above CASTELLO_MAX_SAMPLE_RATE, allocate again and
+            // apply the current parameters. Hosts do not call this
+            // concurrently with run().
+
+            sp_revsc_destroy(&fReverb);
+            sp_revsc_create(&fReverb);
+            fReverb->iParallel = fParallelReady.load(std::memory_order_acquire);
+            sp_revsc_init(fSoundpipe, fReverb);
+            updateParameters(true);
+        }
+
+        setInternalRate(newSampleRate, true);
+    }
+
     void run(const float** inputs, float** outputs, uint32_t frames) override
     {
         float* inpL = (float *)inputs[0];
@@ -183,29 +529,439 @@ public:
         float* outL = outputs[0];
         float* outR = outputs[1];
 
-        // inpX and outX can point to the same memory address
+        updateParameters(false);
 
-        for (uint32_t i = 0; i < frames; ++i) {
-            float l = inpL[i];
-            float r = inpR[i];
-            
-            sp_revsc_compute(fSoundpipe, fReverb, inpL + i, inpR + i, outL + i, outR + i);
+        // Mix gains ramp linearly across the call to the values set last,
+        // dry gain is zero throughout when Mix stays at 100%
+
+        const float dryStep = (fDryTarget - fDry) / frames;
+        const float wetStep = (fWetTarget - fWet) / frames;
+        const bool  wetOnly = (fDry == 0) && (fDryTarget == 0);
+
+        float  inpPeak = std::max(peak(inpL, frames), peak(inpR, frames));
+        float  wetPeak = 0;
+
+        ScopedDenormalsDisable sdd;
+
+        // While sleeping the remaining tail is below SILENCE_THRESHOLD, skip
+        // the reverb and leave it frozen until the input is not silent. This
+        // is also when engines can be switched without dropping a tail.
+
+        if (fSleeping) {
+            // Another internal rate lays the delay lines out again without
+            // clearing them, what they hold is inaudible
+            const bool reduceRate = fReduceRate.load(std::memory_order_acquire);
+
+            if (fRunningReduced != reduceRate) {
+                fRunningReduced = reduceRate;
+                setInternalRate(getSampleRate(), false);
+            }
+
+            switchPrecision();
+
+            if (inpPeak < SILENCE_THRESHOLD) {
+                for (uint32_t offset = 0; offset < frames; offset += kBlockFrames) {
+                    uint32_t    n = frames - offset < kBlockFrames ? frames - offset : kBlockFrames;
+                    const float dry = fDry + dryStep * (offset + 1);
+
+                    std::fill(fWetL, fWetL + n, 0.f);
+                    std::fill(fWetR, fWetR + n, 0.f);
+                    if (!wetOnly) {
+                        mixDry(inpL + offset, fWetL, n, dry, dryStep);
+                        mixDry(inpR + offset, fWetR, n, dry, dryStep);
+                    }
+                    std::copy(fWetL, fWetL + n, outL + offset);
+                    std::copy(fWetR, fWetR + n, outR + offset);
+                }
+
+                fDry = fDryTarget;
+                fWet = fWetTarget;
 
-            outL[i] = fDry * l + fWet * outL[i];
-            outR[i] = fDry * r + fWet * outR[i];
+                return;
+            }
+
+            fSleeping = false;
+            fQuietFrames = 0;
+        }
+
+        // Hosts do not tell offline renders apart, but only send blocks this
+        // large when rendering offline. Blocks above the announced buffer
+        // size do not fit the preallocated output and run on this thread.
+
+        const bool offlineThreads = fOfflineThreads.load(std::memory_order_acquire);
+        const bool parallel = offlineThreads
+                              && fParallelReady.load(std::memory_order_acquire)
+                              && (frames >= OFFLINE_FRAMES)
+                              && (frames - kBlockFrames <= fParallelWetL.size())
+                              && (fRateStages == 0) && !fRunningDouble;
+
+        fReverb->timeBlocked = offlineThreads;
+
+        // inpX and outX can point to the same memory address, so the reverb
+        // renders into scratch buffers, the dry signal is mixed into them and
+        // the result copied to outX
+
+        for (uint32_t offset = 0; offset < frames; offset += kBlockFrames) {
+            uint32_t n = frames - offset < kBlockFrames ? frames - offset : kBlockFrames;
+            float*   bufL = fWetL;
+            float*   bufR = fWetR;
+
+            if (parallel && (offset > 0)) {
+                // Parameters have ramped to their new values in the first
+                // block, the rest is rendered at once for the same output
+                if (offset == kBlockFrames) {
+                    computeReverbParallel(inpL + offset, inpR + offset, frames - offset);
+                }
+
+                bufL = fParallelWetL.data() + offset - kBlockFrames;
+                bufR = fParallelWetR.data() + offset - kBlockFrames;
+            } else if (fRateStages == 0) {
+                computeReverb(inpL + offset, inpR + offset, fWetL, fWetR, n);
+            } else {
+                computeReverbReduced(inpL + offset, inpR + offset, fWetL, fWetR, n);
+            }
+
+            wetPeak = std::max(wetPeak, std::max(peak(bufL, n), peak(bufR, n)));
+
+            const float dry = fDry + dryStep * (offset + 1);
+            const float wet = fWet + wetStep * (offset + 1);
+
+            mixWet(bufL, n, wet, wetStep);
+            mixWet(bufR, n, wet, wetStep);
+            if (!wetOnly) {
+                mixDry(inpL + offset, bufL, n, dry, dryStep);
+                mixDry(inpR + offset, bufR, n, dry, dryStep);
+            }
+            std::copy(bufL, bufL + n, outL + offset);
+            std::copy(bufR, bufR + n, outR + offset);
+        }
+
+        fDry = fDryTarget;
+        fWet = fWetTarget;
+
+        // Sleep after input and output have been quiet for longer than the
+        // longest delay, by then everything in the delay lines is quiet too
+
+        wetPeak = std::max(wetPeak, fRunningDouble ? static_cast<float>(fReverbDouble.peak())
+                                                   : sp_revsc_peak(fReverb));
+
+        if ((inpPeak < SILENCE_THRESHOLD) && (wetPeak < SILENCE_THRESHOLD)) {
+            fQuietFrames += frames;
+            fSleeping = fQuietFrames > static_cast<uint32_t>(sp_revsc_max_delay(fReverb)
+                                                             << fRateStages);
+        } else {
+            fQuietFrames = 0;
         }
     }
 
 private:
+    // Multiple of the largest rate reduction factor
+    static const uint32_t kBlockFrames = 256;
+
+    static const int kMaxRateStages = 3;
+    static const int kMaxRateFactor = 1 << kMaxRateStages;
+
+    // Takes a snapshot of the published parameter values if any changed
+    // since the last one, and sets up the engine from it. Only called by
+    // run() or while run() cannot be running. Values are copied after
+    // reading the serial, a value published meanwhile is applied once more
+    // by the next call.
+    void updateParameters(bool force)
+    {
+        const uint32_t serial = fParameterSerial.load(std::memory_order_acquire);
+
+        if (!force && (serial == fParameterSerialSeen)) {
+            return;
+        }
+
+        fParameterSerialSeen = serial;
+
+        float value[kParameterCount];
+
+        for (int i = 0; i < kParameterCount; ++i) {
+            value[i] = fParameters[i].load(std::memory_order_relaxed);
+        }
+
+        // Applied by run() as a ramp, exactly zero dry at 100% allows the
+        // wet only path
+        const float mix = value[kParameterMix];
+
+        fDryTarget = mix >= 1.f ? 0.f : mix < 0.5f ? 1.f : 1.f - log(mix / 0.5f) / LOG_2;
+        fWetTarget = mix > 0.5f ? 1.f : 1.f - log((1.f - mix) / 0.5f) / LOG_2;
+
+        fReverb->feedback = 0.5f + value[kParameterSize] / 2.f;
+        fReverb->lpfreq = exp(LOG_400 + (LOG_10000 - LOG_400) * value[kParameterBrightness]);
+
+        const int quality = static_cast<int>(value[kParameterQuality]);
+
+        fReverb->interpolation = quality == kQualityEco ? SP_REVSC_NONE
+                               : quality == kQualityNormal ? SP_REVSC_LINEAR
+                               : SP_REVSC_CUBIC;
+        fReverb->iPitchMod = quality == kQualityEco ? 0 : 1;
+    }
+
+    // Runs the engine selected by the "precision" state from now on. Only
+    // called while sleeping, the delay lines of both engines hold nothing
+    // audible and are kept. setState() lays the double precision engine out
+    // at the internal rate, if that changed before run() got to it the lines
+    // are laid out again without clearing.
+    void switchPrecision()
+    {
+        const bool doublePrecision = fDoublePrecision.load(std::memory_order_acquire);
+
+        if (fRunningDouble == doublePrecision) {
+            return;
+        }
+
+        fRunningDouble = doublePrecision;
+
+        if (fRunningDouble && (fReverbDouble.sampleRate() != fSoundpipe->sr)) {
+            fReverbDouble.relayout(fSoundpipe->sr);
+        }
+    }
+
+    // Runs the active engine at the internal rate, in and out can be the same
+    void computeReverb(float* inL, float* inR, float* outL, float* outR, uint32_t frames)
+    {
+        if (fRunningDouble) {
+            fReverbDouble.feedback = fReverb->feedback;
+            fReverbDouble.lpfreq = fReverb->lpfreq;
+            fReverbDouble.interpolation = fReverb->interpolation;
+            fReverbDouble.pitchMod = fReverb->iPitchMod;
+            fReverbDouble.process(inL, inR, outL, outR, frames);
+        } else {
+            sp_revsc_compute_block(fSoundpipe, fReverb, inL, inR, outL, outR, frames);
+        }
+    }
+
+    // Runs fReverb with its delay lines on the worker pool, output goes to
+    // fParallelWetL and fParallelWetR. Only for offline renders, fReverb is
+    // already time blocked.
+    void computeReverbParallel(float* inL, float* inR, uint32_t frames)
+    {
+        fReverb->parallel = runParallel;
+        fReverb->parallelData = &fWorkers;
+
+        sp_revsc_compute_block(fSoundpipe, fReverb, inL, inR, fParallelWetL.data(),
+                               fParallelWetR.data(), frames);
+
+        fReverb->parallel = 0;
+    }
+
+    static void runParallel(void* data, sp_revsc_task task, void* arg, int count)
+    {
+        static_cast<WorkerPool*>(data)->run(task, arg, count);
+    }
+
+    // One worker per delay line besides the calling thread at most, started
+    // by the first setState() that enables the "threads" state together with
+    // the buffers of the parallel path. Sets fParallelReady, not on a single
+    // core. Not real-time safe.
+    void startWorkers()
+    {
+        if (fParallelReady.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        const int cores = static_cast<int>(std::thread::hardware_concurrency());
+        const int workers = std::min(cores, fReverb->iLines) - 1;
+
+        if (workers < 1) {
+            return;
+        }
+
+        fWorkers.start(workers);
+        sp_revsc_init_parallel(fReverb);
+        resizeParallelBuffers(getBufferSize());
+
+        fParallelReady.store(true, std::memory_order_release);
+    }
+
+    // The parallel path renders all but the first kBlockFrames of a call
+    void resizeParallelBuffers(uint32_t bufferSize)
+    {
+        const uint32_t frames = bufferSize > kBlockFrames ? bufferSize - kBlockFrames : 0;
+
+        fParallelWetL.resize(frames);
+        fParallelWetR.resize(frames);
+    }
+
+    // Decimates the input to the internal rate, runs the reverb there and
+    // interpolates the result back to the host rate
+    void computeReverbReduced(float* inL, float* inR, float* wetL, float* wetR, uint32_t frames)
+    {
+        float    bufL[2][kBlockFrames];
+        float    bufR[2][kBlockFrames];
+        float*   srcL = inL;
+        float*   srcR = inR;
+        uint32_t n = frames;
+        int      cur = 0;
+
+        for (int i = 0; i < fRateStages; ++i) {
+            fDecimatorR[i].process(srcR, n, bufR[0]);
+            n = fDecimatorL[i].process(srcL, n, bufL[0]);
+            srcL = bufL[0];
+            srcR = bufR[0];
+        }
+
+        computeReverb(bufL[0], bufR[0], bufL[0], bufR[0], n);
+
+        for (int i = fRateStages - 1; i >= 0; --i) {
+            fInterpolatorL[i].process(bufL[cur], n, bufL[cur ^ 1]);
+            fInterpolatorR[i].process(bufR[cur], n, bufR[cur ^ 1]);
+            cur ^= 1;
+            n *= 2;
+        }
+
+        // Frames pending in the decimators are made up for by the carry, so
+        // that fCarryFrames + n >= frames always holds
+
+        const uint32_t carry = fCarryFrames;
+
+        std::copy(fCarryL, fCarryL + carry, wetL);
+        std::copy(fCarryR, fCarryR + carry, wetR);
+        std::copy(bufL[cur], bufL[cur] + frames - carry, wetL + carry);
+        std::copy(bufR[cur], bufR[cur] + frames - carry, wetR + carry);
+
+        fCarryFrames = carry + n - frames;
+        std::copy(bufL[cur] + frames - carry, bufL[cur] + n, fCarryL);
+        std::copy(bufR[cur] + frames - carry, bufR[cur] + n, fCarryR);
+    }
+
+    // Number of times the host rate is halved for the reverb
+    static int rateStages(double sampleRate, bool reduced)
+    {
+        int stages = 0;
+
+        if (reduced) {
+            while ((stages < kMaxRateStages) && (sampleRate / (2 << stages) >= 44100)) {
+                stages++;
+            }
+        }
+
+        return stages;
+    }
+
+    // Lays the engines out for the internal rate and resets the resamplers.
+    // The delay lines are only cleared if clear is set, which costs time in
+    // proportion to their size and is left out on the audio thread.
+    void setInternalRate(double sampleRate, bool clear)
+    {
+        fRateStages = rateStages(sampleRate, fRunningReduced);
+        fSoundpipe->sr = static_cast<int>(sampleRate) >> fRateStages;
+
+        if (clear) {
+            sp_revsc_reset(fSoundpipe, fReverb);
+        } else {
+            sp_revsc_relayout(fSoundpipe, fReverb);
+        }
+
+        if (fDoubleReady.load(std::memory_order_acquire)) {
+            if (clear) {
+                fReverbDouble.reset(fSoundpipe->sr);
+            } else {
+                fReverbDouble.relayout(fSoundpipe->sr);
+            }
+        }
+
+        for (int i = 0; i < kMaxRateStages; ++i) {
+            fDecimatorL[i].reset();
+            fDecimatorR[i].reset();
+            fInterpolatorL[i].reset();
+            fInterpolatorR[i].reset();
+        }
+
+        // Output lags the input by up to one frame at the internal rate
+        fCarryFrames = (1 << fRateStages) - 1;
+        std::fill(fCarryL, fCarryL + kMaxRateFactor, 0.f);
+        std::fill(fCarryR, fCarryR + kMaxRateFactor, 0.f);
+    }
+
+    // Scales buf by a gain that starts at gain and changes by step every
+    // frame, nothing to do at a steady unity gain
+    static void mixWet(float* buf, uint32_t frames, float gain, float step)
+    {
+        if ((gain == 1.f) && (step == 0)) {
+            return;
+        }
+
+        for (uint32_t i = 0; i < frames; ++i) {
+            buf[i] *= gain + step * i;
+        }
+    }
+
+    // Adds in to buf with a ramped gain like mixWet(), buf is one of the
+    // scratch buffers so that the loop vectorizes without alias checks
+    static void mixDry(const float* __restrict in, float* __restrict buf, uint32_t frames,
+                       float gain, float step)
+    {
+        for (uint32_t i = 0; i < frames; ++i) {
+            buf[i] += (gain + step * i) * in[i];
+        }
+    }
+
+    static float peak(const float* buf, uint32_t frames)
+    {
+        float value = 0;
+
+        for (uint32_t i = 0; i < frames; ++i) {
+            value = std::max(value, std::fabs(buf[i]));
+        }
+
+        return value;
+    }
+
     typedef std::unordered_map<std::string,std::string> StateMap;
 
     sp_data*  fSoundpipe;
     sp_revsc* fReverb;
-    float     fMix;
     float     fDry;
     float     fWet;
+    float     fDryTarget;
+    float     fWetTarget;
+    float     fWetL[kBlockFrames];
+    float     fWetR[kBlockFrames];
+    uint32_t  fQuietFrames;
+    bool      fSleeping;
     StateMap  fState;
 
+    // Normalized parameter values as last set from any thread, the serial
+    // counts the changes. The snapshot taken by updateParameters() is only
+    // touched by the audio thread.
+    std::atomic<float>    fParameters[kParameterCount];
+    std::atomic<uint32_t> fParameterSerial;
+    uint32_t              fParameterSerialSeen;
+
+    // Same algorithm in double precision, used instead of fReverb while the
+    // "precision" state is "double". Meant for final renders, follows Quality
+    // like fReverb but always stores samples as double. Memory is allocated
+    // by the first setState() that enables it, which then sets fDoubleReady.
+    RevSC<double>     fReverbDouble;
+    std::atomic<bool> fDoublePrecision;
+    std::atomic<bool> fDoubleReady;
+    bool              fRunningDouble;
+
+    // Reverb runs at the host rate halved fRateStages times while the
+    // "internal_rate" state is "reduced"
+    HalfbandDecimator    fDecimatorL[kMaxRateStages];
+    HalfbandDecimator    fDecimatorR[kMaxRateStages];
+    HalfbandInterpolator fInterpolatorL[kMaxRateStages];
+    HalfbandInterpolator fInterpolatorR[kMaxRateStages];
+    float                fCarryL[kMaxRateFactor];
+    float                fCarryR[kMaxRateFactor];
+    uint32_t             fCarryFrames;
+    int                  fRateStages;
+    std::atomic<bool>    fReduceRate;
+    bool                 fRunningReduced;
+
+    // Offline renders with the "threads" state set to "offline". Workers and
+    // buffers exist once fParallelReady is set, run() never allocates them.
+    WorkerPool         fWorkers;
+    std::vector<float> fParallelWetL;
+    std::vector<float> fParallelWetR;
+    std::atomic<bool>  fOfflineThreads;
+    std::atomic<bool>  fParallelReady;
+
 };
 
 Plugin* createPlugin()
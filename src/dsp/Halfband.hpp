@@ -0,0 +1,211 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HALFBAND_HPP
+#define HALFBAND_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// 31-tap halfband lowpass for sample rate conversion by a factor of 2,
+// Kaiser windowed for about 80 dB of stopband attenuation. Even taps other
+// than the center one are zero, so the polyphase forms below only compute
+// kPairs symmetric pairs of odd taps. Passband is flat up to 1/6 of the
+// higher rate, 16 kHz at 96 kHz.
+
+class Halfband
+{
+public:
+    Halfband()
+    {
+        const double beta = 8.0;
+        double sum = 0;
+
+        for (int k = 0; k < kPairs; ++k) {
+            const double d = 2 * k + 1;
+            const double r = d / (kCenter + 1);
+            const double sinc = std::sin(M_PI * d / 2) / (M_PI * d / 2);
+
+            fCoef[k] = 0.5 * sinc * besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+            sum += fCoef[k];
+        }
+
+        // Unity gain at DC, the center tap is 0.5
+        for (int k = 0; k < kPairs; ++k) {
+            fCoef[k] = static_cast<float>(fCoef[k] * 0.25 / sum);
+        }
+    }
+
+protected:
+    static const int kPairs = 8;
+    static const int kCenter = 2 * kPairs - 1;
+
+    float fCoef[kPairs];
+
+private:
+    static double besselI0(double x)
+    {
+        double sum = 1, term = 1;
+
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+};
+
+// Halves the sample rate of one channel, output has a delay of kCenter
+// samples at the input rate. Input is split into even and odd samples so
+// that each output is a contiguous dot product and loops vectorize.
+class HalfbandDecimator : public Halfband
+{
+public:
+    HalfbandDecimator()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::memset(fEven, 0, sizeof(fEven));
+        std::memset(fOdd, 0, sizeof(fOdd));
+        fPending = 0;
+        fHasPending = false;
+    }
+
+    // Returns the number of samples written, one for every two read. Odd
+    // input counts carry over to the next call. in and out can be the same.
+    uint32_t process(const float* in, uint32_t frames, float* out)
+    {
+        uint32_t count = 0;
+        uint32_t i = 0;
+
+        while (i < frames) {
+            float    y[kChunk];
+            uint32_t n = 0;
+
+            if (fHasPending) {
+                fEven[kCenter] = fPending;
+                fOdd[kCenter] = in[i++];
+                fHasPending = false;
+                n = 1;
+            }
+
+            for (; (i + 1 < frames) && (n < kChunk); i += 2, ++n) {
+                fEven[kCenter + n] = in[i];
+                fOdd[kCenter + n] = in[i + 1];
+            }
+
+            if ((i + 1 == frames) && (n < kChunk)) {
+                fPending = in[i++];
+                fHasPending = true;
+            }
+
+            // Newest pair is at kCenter + j, 2 * kCenter + 1 samples back
+            // from its odd sample the window starts at an odd sample
+            for (uint32_t j = 0; j < n; ++j) {
+                y[j] = 0.5f * fEven[j + kPairs];
+            }
+
+            for (int k = 0; k < kPairs; ++k) {
+                const float c = fCoef[k];
+
+                for (uint32_t j = 0; j < n; ++j) {
+                    y[j] += c * (fOdd[j + kPairs - 1 - k] + fOdd[j + kPairs + k]);
+                }
+            }
+
+            std::memcpy(out + count, y, n * sizeof(float));
+            std::memmove(fEven, fEven + n, kCenter * sizeof(float));
+            std::memmove(fOdd, fOdd + n, kCenter * sizeof(float));
+            count += n;
+        }
+
+        return count;
+    }
+
+private:
+    static const uint32_t kChunk = 64;
+
+    float fEven[kCenter + kChunk];
+    float fOdd[kCenter + kChunk];
+    float fPending;
+    bool  fHasPending;
+
+};
+
+// Doubles the sample rate of one channel, output has a delay of kCenter
+// samples at the output rate
+class HalfbandInterpolator : public Halfband
+{
+public:
+    HalfbandInterpolator()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::memset(fHistory, 0, sizeof(fHistory));
+    }
+
+    // Writes 2 * frames samples, out must not overlap in
+    void process(const float* in, uint32_t frames, float* out)
+    {
+        for (uint32_t i = 0; i < frames; ) {
+            const uint32_t n = frames - i < kChunk ? frames - i : kChunk;
+            float y[kChunk];
+
+            std::memcpy(fHistory + kCenter, in + i, n * sizeof(float));
+
+            // Newest sample is at kCenter + j, one phase is a plain delay and
+            // the other one the odd taps with a gain of 2
+            for (uint32_t j = 0; j < n; ++j) {
+                y[j] = 0;
+            }
+
+            for (int k = 0; k < kPairs; ++k) {
+                const float c = 2.f * fCoef[k];
+
+                for (uint32_t j = 0; j < n; ++j) {
+                    y[j] += c * (fHistory[j + kPairs - 1 - k] + fHistory[j + kPairs + k]);
+                }
+            }
+
+            for (uint32_t j = 0; j < n; ++j) {
+                out[2 * (i + j)] = y[j];
+                out[2 * (i + j) + 1] = fHistory[j + kPairs];
+            }
+
+            std::memmove(fHistory, fHistory + n, kCenter * sizeof(float));
+            i += n;
+        }
+    }
+
+private:
+    static const uint32_t kChunk = 64;
+
+    float fHistory[kCenter + kChunk];
+
+};
+
+#endif // HALFBAND_HPP
@@ -0,0 +1,392 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REVSC_HPP
+#define REVSC_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include "soundpipe.h"
+}
+
+// Header-only port of the sp_revsc algorithm in revsc.c, the sample type is a
+// template parameter. Every constant in the processing loop is of type
+// Sample, so RevSC<float> computes in float only and RevSC<double> in double
+// only, independently of SPFLOAT.
+//
+// The delay line sizes, the initial read positions and the random line
+// segments come from revsc.c, so that read positions match sp_revsc sample by
+// sample whatever the floating point flags of the caller, and only the
+// precision of the signal path differs. Number of lines, interpolation and
+// pitch modulation mean the same as in sp_revsc. Delay lines always store
+// Sample, there is no equivalent of sp_revsc.iStorage. The lines are run one
+// after the other without SIMD kernels, both RevSC<float> and RevSC<double>
+// take 2.5 to 4 times the CPU time of sp_revsc, see bench/revsc_precision.cpp.
+
+template <typename Sample>
+class RevSC
+{
+public:
+    // Same meaning as in sp_revsc, can be changed between process() calls
+    Sample  feedback;
+    Sample  lpfreq;
+    int     interpolation;
+    SPFLOAT pitchMod;
+
+    RevSC()
+        : feedback(Sample(0.97))
+        , lpfreq(Sample(10000))
+        , interpolation(SP_REVSC_CUBIC)
+        , pitchMod(1)
+        , fSampleRate(0)
+        , fMaxSampleRate(0)
+        , fLineCount(8)
+        , fJpScale(0)
+        , fOutputGain(0)
+        , fDampFact(1)
+        , fPrvLpFreq(0)
+        , fPrvFeedback(0)
+        , fPrvPitchMod(1)
+        , fAntiDenormal(kAntiDenormal)
+    {}
+
+    // Allocates delay memory for rates up to maxSampleRate and resets. Lines
+    // is 4, 8 or 16 like sp_revsc.iLines, anything else means 8.
+    void init(double sampleRate, double maxSampleRate, int lines = 8)
+    {
+        size_t size = 0;
+
+        fLineCount = (lines == 4) || (lines == 16) ? lines : 8;
+        fJpScale = static_cast<Sample>(2.0 / fLineCount);
+        fOutputGain = static_cast<Sample>(0.35 * std::sqrt(8.0 / fLineCount));
+        fMaxSampleRate = std::max(sampleRate, maxSampleRate);
+
+        for (int n = 0; n < fLineCount; ++n) {
+            size += maxSamples(fMaxSampleRate, n) + 2 * kGuard;
+        }
+
+        fMemory.assign(size, Sample(0));
+        reset(sampleRate);
+    }
+
+    // Lays out and clears the delay lines without allocating, returns false
+    // if sampleRate is above the rate passed to init()
+    bool reset(double sampleRate)
+    {
+        return layout(sampleRate, true);
+    }
+
+    // Same as reset() but the delay memory is left as it is, like
+    // sp_revsc_relayout(). Only for when the tail has already decayed.
+    bool relayout(double sampleRate)
+    {
+        return layout(sampleRate, false);
+    }
+
+    // Rate the delay lines are laid out for, 0 before init()
+    double sampleRate() const
+    {
+        return fSampleRate;
+    }
+
+    // Input takes at most this many frames to reach the output
+    int maxDelay() const
+    {
+        int size = 0;
+
+        for (int n = 0; n < fLineCount; ++n) {
+            size = std::max(size, maxSamples(fSampleRate, n));
+        }
+
+        return size;
+    }
+
+    // Largest absolute filter state, tells whether the tail has decayed
+    Sample peak() const
+    {
+        Sample value = 0;
+
+        for (int n = 0; n < fLineCount; ++n) {
+            value = std::max(value, std::fabs(fLines[n].filterState));
+        }
+
+        return value;
+    }
+
+    // Input and output can be of a different type than Sample. Damping and
+    // feedback ramp to their new values across the call, and a new pitchMod
+    // restarts the random segments from the current delays, like in revsc.c.
+    template <typename T>
+    void process(const T* in1, const T* in2, T* out1, T* out2, uint32_t frames)
+    {
+        Sample dampFact = fDampFact;
+
+        if (frames == 0) {
+            return;
+        }
+
+        if (lpfreq != fPrvLpFreq) {
+            // Once per call in double precision, cast for the loop
+            double d = 2.0 - std::cos(lpfreq * 6.283185307179586 / fSampleRate);
+            dampFact = static_cast<Sample>(d - std::sqrt(d * d - 1.0));
+
+            if (fPrvLpFreq == 0) {
+                fDampFact = dampFact;
+                fPrvFeedback = feedback;
+            }
+
+            fPrvLpFreq = lpfreq;
+        }
+
+        if (pitchMod != fPrvPitchMod) {
+            for (int n = 0; n < fLineCount; ++n) {
+                restartRandomLineseg(fLines[n], n);
+            }
+
+            fPrvPitchMod = pitchMod;
+        }
+
+        const Sample dampStep = (dampFact - fDampFact) / Sample(frames);
+        const Sample feedbackStep = (feedback - fPrvFeedback) / Sample(frames);
+
+        switch (interpolation) {
+        case SP_REVSC_NONE:
+            processLines<SP_REVSC_NONE>(in1, in2, out1, out2, frames, dampStep, feedbackStep);
+            break;
+        case SP_REVSC_LINEAR:
+            processLines<SP_REVSC_LINEAR>(in1, in2, out1, out2, frames, dampStep, feedbackStep);
+            break;
+        default:
+            processLines<SP_REVSC_CUBIC>(in1, in2, out1, out2, frames, dampStep, feedbackStep);
+            break;
+        }
+
+        fDampFact = dampFact;
+        fPrvFeedback = feedback;
+    }
+
+private:
+    struct DelayLine
+    {
+        Sample* buffer;
+        Sample  filterState;
+        int     bufferSize;
+        int     writePos;
+        int     readPos;
+        int     readPosFrac;
+        int     readPosFracInc;
+        int     randLineCnt;
+        int     seed;
+        int64_t delay; // at the end of the current segment, in 1/kPosScale samples
+    };
+
+    // Lines one after the other in fMemory, sized for sampleRate
+    bool layout(double sampleRate, bool clear)
+    {
+        if (sampleRate > fMaxSampleRate) {
+            return false;
+        }
+
+        const SPFLOAT sr = static_cast<SPFLOAT>(sampleRate);
+        Sample* buffer = fMemory.data();
+
+        fSampleRate = sampleRate;
+        fDampFact = 1;
+        fPrvLpFreq = 0;
+        fPrvFeedback = feedback;
+        fPrvPitchMod = pitchMod;
+        fAntiDenormal = kAntiDenormal;
+
+        for (int n = 0; n < fLineCount; ++n) {
+            DelayLine& dl = fLines[n];
+
+            dl.bufferSize = maxSamples(sampleRate, n);
+            dl.buffer = buffer + kGuard;
+            buffer += dl.bufferSize + 2 * kGuard;
+            if (clear) {
+                std::fill(dl.buffer - kGuard, buffer, Sample(0));
+            }
+
+            sp_revsc_line_start(sr, pitchMod, n, dl.bufferSize, &dl.seed, &dl.readPos,
+                                &dl.readPosFrac);
+            dl.writePos = 0;
+            dl.filterState = 0;
+
+            restartRandomLineseg(dl, n);
+        }
+
+        return true;
+    }
+
+    template <int Interpolation, typename T>
+    void processLines(const T* in1, const T* in2, T* out1, T* out2, uint32_t frames,
+                      Sample dampStep, Sample feedbackStep)
+    {
+        const int lines = fLineCount;
+        Sample damp = fDampFact;
+        Sample fb = fPrvFeedback;
+        Sample dn = fAntiDenormal;
+
+        for (uint32_t i = 0; i < frames; ++i) {
+            damp += dampStep;
+            fb += feedbackStep;
+
+            // "resultant junction pressure" mixed to the input signals
+            Sample junction = 0;
+
+            for (int n = 0; n < lines; ++n) {
+                junction += fLines[n].filterState;
+            }
+
+            junction = junction * fJpScale + dn;
+            dn = -dn;
+
+            const Sample ainL = junction + static_cast<Sample>(in1[i]);
+            const Sample ainR = junction + static_cast<Sample>(in2[i]);
+            Sample aoutL = 0;
+            Sample aoutR = 0;
+
+            for (int n = 0; n < lines; ++n) {
+                DelayLine& dl = fLines[n];
+                Sample* buf = dl.buffer;
+
+                // Write, samples near either end also go to the guard at the
+                // other end so that the taps never need to wrap
+                const Sample ain = ((n & 1) ? ainR : ainL) - dl.filterState;
+
+                buf[dl.writePos] = ain;
+                if (dl.writePos < kGuard) {
+                    buf[dl.writePos + dl.bufferSize] = ain;
+                } else if (dl.writePos >= dl.bufferSize - kGuard) {
+                    buf[dl.writePos - dl.bufferSize] = ain;
+                }
+                if (++dl.writePos == dl.bufferSize) {
+                    dl.writePos = 0;
+                }
+
+                dl.readPos += dl.readPosFrac >> kPosShift;
+                dl.readPosFrac &= kPosMask;
+                if (dl.readPos >= dl.bufferSize) {
+                    dl.readPos -= dl.bufferSize;
+                }
+
+                const Sample* tap = buf + dl.readPos;
+                Sample v;
+
+                if (Interpolation == SP_REVSC_CUBIC) {
+                    // Cubic Lagrange interpolation, same arrangement as revsc.c
+                    const Sample frac = static_cast<Sample>(dl.readPosFrac) * kFracScale;
+                    Sample a2 = (frac * frac - 1) * kOneSixth;
+                    Sample a1 = (frac + 1) * kOneHalf;
+                    Sample am1 = a1 - 1;
+                    Sample a0 = 3 * a2;
+                    a1 -= a0;
+                    am1 -= a2;
+                    a0 -= frac;
+
+                    v = (am1 * tap[-1] + a0 * tap[0] + a1 * tap[1] + a2 * tap[2]) * frac + tap[0];
+                } else if (Interpolation == SP_REVSC_LINEAR) {
+                    const Sample frac = static_cast<Sample>(dl.readPosFrac) * kFracScale;
+
+                    v = tap[0] + (tap[1] - tap[0]) * frac;
+                } else {
+                    v = tap[0];
+                }
+
+                dl.readPosFrac += dl.readPosFracInc;
+
+                // Feedback gain and lowpass filter
+                v *= fb;
+                v = (dl.filterState - v) * damp + v;
+                dl.filterState = v;
+
+                if (n & 1) {
+                    aoutR += v;
+                } else {
+                    aoutL += v;
+                }
+
+                if (--dl.randLineCnt <= 0) {
+                    nextRandomLineseg(dl, n);
+                }
+            }
+
+            out1[i] = static_cast<T>(aoutL * fOutputGain);
+            out2[i] = static_cast<T>(aoutR * fOutputGain);
+        }
+
+        fAntiDenormal = dn;
+    }
+
+    static constexpr int kMaxLines = SP_REVSC_MAX_LINES;
+    static constexpr int kGuard = 2;
+    static constexpr int kPosShift = 28;
+    static constexpr int kPosScale = 1 << kPosShift;
+    static constexpr int kPosMask = kPosScale - 1;
+
+    static constexpr Sample kAntiDenormal = Sample(1e-18);
+    static constexpr Sample kFracScale = Sample(1) / Sample(kPosScale);
+    static constexpr Sample kOneSixth = Sample(1) / Sample(6);
+    static constexpr Sample kOneHalf = Sample(0.5);
+
+    // Line size with the full modulation depth, like sp_revsc
+    static int maxSamples(double sampleRate, int n)
+    {
+        return sp_revsc_line_samples(static_cast<SPFLOAT>(sampleRate), 1, n);
+    }
+
+    // Starts a new segment from the delay at the current read and write
+    // positions, as restart_random_lineseg()
+    void restartRandomLineseg(DelayLine& dl, int n)
+    {
+        dl.delay = (static_cast<int64_t>(dl.writePos) - dl.readPos) * kPosScale - dl.readPosFrac;
+        while (dl.delay < 0) {
+            dl.delay += static_cast<int64_t>(dl.bufferSize) * kPosScale;
+        }
+
+        nextRandomLineseg(dl, n);
+    }
+
+    // Starts the next random line segment, the delay at its start is known
+    // exactly from the previous segment
+    void nextRandomLineseg(DelayLine& dl, int n)
+    {
+        dl.randLineCnt = sp_revsc_line_segment(static_cast<SPFLOAT>(fSampleRate), pitchMod, n,
+                                               &dl.seed, &dl.delay, &dl.readPosFracInc);
+    }
+
+    double              fSampleRate;
+    double              fMaxSampleRate;
+    int                 fLineCount;
+    Sample              fJpScale;
+    Sample              fOutputGain;
+    Sample              fDampFact;
+    Sample              fPrvLpFreq;
+    Sample              fPrvFeedback;
+    SPFLOAT             fPrvPitchMod;
+    Sample              fAntiDenormal;
+    DelayLine           fLines[kMaxLines];
+    std::vector<Sample> fMemory;
+
+};
+
+#endif // REVSC_HPP
@@ -14,6 +14,11 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "soundpipe.h"
 
 #define DEFAULT_SRATE   44100.0
@@ -24,16 +29,144 @@
 #define DELAYPOS_SCALE  0x10000000
 #define DELAYPOS_MASK   0x0FFFFFFF
 
+/* Samples mirrored before and after each delay line, so that the four taps
+   around readPos never need to wrap. */
+#define DELAY_GUARD     2
+
+/* Alignment of the delay line state at the end of aux */
+#define DL_ALIGN        64
+
+/* SP_REVSC_INT16 samples are scaled by this. Full scale sines with high
+   feedback build up to about +-24 in the delay lines, the range is +-32 with
+   quantization noise about 71 dB below 1.0. */
+#define INT16_SCALE     1024
+
+/* Most frames compute_block_tb() runs through its three passes at once, a
+   multiple of 8 */
+#define TB_FRAMES       128
+
+/* Same with sp_revsc.parallel, long enough for each task to outweigh the
+   synchronization. Runs are bounded by the shortest delay anyway. */
+#define TB_PARALLEL_FRAMES 2048
+
 #ifndef M_PI
 #define M_PI		3.14159265358979323846	/* pi */
 #endif
 
-/* reverbParams[n][0] = delay time (in seconds)                     */
-/* reverbParams[n][1] = random variation in delay time (in seconds) */
-/* reverbParams[n][2] = random variation frequency (in 1/sec)       */
-/* reverbParams[n][3] = random seed (0 - 32767)                     */
+#if defined(__GNUC__) && !defined(SP_REVSC_NO_SIMD)
+#define REVSC_SIMD
+#endif
+
+/* The delay line math shared with RevSC.hpp is never inlined or cloned, so
+   that sp_revsc and RevSC run the same code and round the same way with any
+   floating point flags, -ffast-math included */
+#if defined(__GNUC__) && !defined(__clang__)
+#define REVSC_SHARED __attribute__((noinline, noclone))
+#elif defined(__GNUC__)
+#define REVSC_SHARED __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define REVSC_SHARED __declspec(noinline)
+#else
+#define REVSC_SHARED
+#endif
+
+/* On x86 the kernels are also built for AVX2 and AVX-512, the first
+   sp_revsc_init() picks the best set the CPU supports */
+#if defined(REVSC_SIMD) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(SP_REVSC_NO_DISPATCH)
+#define REVSC_DISPATCH
+#endif
+
+#ifdef REVSC_SIMD
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* One lane per delay line, in vectors of each number of lines */
+
+typedef SPFLOAT revsc_vf_4 __attribute__((vector_size(4 * sizeof(SPFLOAT))));
+typedef SPFLOAT revsc_vf_8 __attribute__((vector_size(8 * sizeof(SPFLOAT))));
+typedef SPFLOAT revsc_vf_16 __attribute__((vector_size(16 * sizeof(SPFLOAT))));
+typedef int32_t revsc_vi_4 __attribute__((vector_size(4 * sizeof(int32_t))));
+typedef int32_t revsc_vi_8 __attribute__((vector_size(8 * sizeof(int32_t))));
+typedef int32_t revsc_vi_16 __attribute__((vector_size(16 * sizeof(int32_t))));
+typedef float revsc_vf32_4 __attribute__((vector_size(4 * sizeof(float))));
+typedef float revsc_vf32_8 __attribute__((vector_size(8 * sizeof(float))));
+typedef float revsc_vf32_16 __attribute__((vector_size(16 * sizeof(float))));
+
+/* Sample rates with kernels specialized for their delay line layout, index 0
+   stands for any other rate and selects the generic kernels. Only for
+   networks of 8 lines. */
+
+#define RATE_VARIANTS 6
+
+static const int variantRates[RATE_VARIANTS] = {
+    0, 44100, 48000, 88200, 96000, 192000
+};
+
+/* sp_revsc_line_samples() at each of variantRates, as constants that the
+   compiler sees when a kernel is specialized */
+
+static const int variantSizes[RATE_VARIANTS][8] = {
+    { 0 },
+    { 2539, 2838, 3317, 3603, 3973, 4198, 2243, 1979 },
+    { 2762, 3087, 3609, 3920, 4323, 4567, 2440, 2152 },
+    { 5061, 5659, 6619, 7190, 7929, 8379, 4471, 3942 },
+    { 5507, 6158, 7203, 7824, 8629, 9119, 4865, 4289 },
+    { 10999, 12300, 14389, 15632, 17242, 18221, 9713, 8561 }
+};
+
+/* buffer size and offset of line n as laid out by sp_revsc_reset() */
+
+static inline __attribute__((always_inline))
+int variant_buffer_size(const int rate, const int pow2, const int n)
+{
+    int size = variantSizes[rate][n];
+    int pow2Size = 1;
+
+    if (!pow2) return size;
+    while (pow2Size < size) pow2Size <<= 1;
+    return pow2Size;
+}
+
+static inline __attribute__((always_inline))
+int variant_buffer_offset(const int rate, const int pow2, const int n)
+{
+    int offset = DELAY_GUARD, k;
+
+    for (k = 0; k < n; k++) {
+        offset += variant_buffer_size(rate, pow2, k) + 2 * DELAY_GUARD;
+    }
+    return offset;
+}
+
+/* Index of the specialized kernels for the current layout, 0 if there are
+   none or the runtime sizes do not match the constants */
+
+static int rate_variant(sp_revsc *p)
+{
+    int rate, n;
+
+    if (p->iLines != 8) return 0;
+    for (rate = 1; rate < RATE_VARIANTS; rate++) {
+        if (p->sampleRate == variantRates[rate]) break;
+    }
+    if (rate == RATE_VARIANTS) return 0;
+    for (n = 0; n < 8; n++) {
+        if (p->delayLines.bufferSize[n] != variant_buffer_size(rate, p->iPow2Size != 0, n)
+            || p->delayLines.bufferOffset[n] != variant_buffer_offset(rate, p->iPow2Size != 0, n))
+            return 0;
+    }
+    return rate;
+}
+#endif /* REVSC_SIMD */
+
+/* A network of N lines uses the first N rows. Delay times are primes at
+   44.1 kHz, the averages of the first 4, 8 and 16 are close to each other so
+   that the decay time for a given feedback does not depend much on N. Even
+   lines feed the left output and odd lines the right one. */
 
-static const SPFLOAT reverbParams[8][4] = {
+const SPFLOAT sp_revsc_params[SP_REVSC_MAX_LINES][4] = {
     { (2473.0 / DEFAULT_SRATE), 0.0010, 3.100,  1966.0 },
     { (2767.0 / DEFAULT_SRATE), 0.0011, 3.500, 29491.0 },
     { (3217.0 / DEFAULT_SRATE), 0.0017, 1.110, 22937.0 },
@@ -41,236 +174,1599 @@ static const SPFLOAT reverbParams[8][4] = {
     { (3907.0 / DEFAULT_SRATE), 0.0010, 2.341, 20643.0 },
     { (4127.0 / DEFAULT_SRATE), 0.0011, 1.897, 22937.0 },
     { (2143.0 / DEFAULT_SRATE), 0.0017, 0.891, 29491.0 },
-    { (1933.0 / DEFAULT_SRATE), 0.0006, 3.221, 14417.0 }
+    { (1933.0 / DEFAULT_SRATE), 0.0006, 3.221, 14417.0 },
+    { (2011.0 / DEFAULT_SRATE), 0.0013, 2.713,  5243.0 },
+    { (3371.0 / DEFAULT_SRATE), 0.0009, 1.553, 17039.0 },
+    { (2857.0 / DEFAULT_SRATE), 0.0015, 3.359, 26869.0 },
+    { (2203.0 / DEFAULT_SRATE), 0.0008, 2.111, 11797.0 },
+    { (3673.0 / DEFAULT_SRATE), 0.0012, 1.327, 31457.0 },
+    { (3061.0 / DEFAULT_SRATE), 0.0014, 3.719,  3932.0 },
+    { (4013.0 / DEFAULT_SRATE), 0.0007, 0.977, 24903.0 },
+    { (2591.0 / DEFAULT_SRATE), 0.0016, 2.897,  8520.0 }
 };
 
-static int delay_line_max_samples(SPFLOAT sr, SPFLOAT iPitchMod, int n);
-static int init_delay_line(sp_revsc *p, sp_revsc_dl *lp, int n);
-static int delay_line_bytes_alloc(SPFLOAT sr, SPFLOAT iPitchMod, int n);
+static int init_delay_line(sp_revsc *p, int n, int clear);
+static int delay_line_buffer_size(sp_revsc *p, SPFLOAT sr, int n);
+static int delay_line_bytes_alloc(sp_revsc *p, SPFLOAT sr, int n);
+#ifdef REVSC_SIMD
+static void select_kernels(void);
+#endif
 static const SPFLOAT outputGain  = 0.35;
-static const SPFLOAT jpScale     = 0.25;
+
+/* Every line gets the sum of all lines scaled by 2 / N minus its own state,
+   which is lossless for any N. The output gain of 8 lines is adjusted for
+   the level of N / 2 uncorrelated lines per channel. */
+
+static inline SPFLOAT junction_scale(int lines)
+{
+    return (SPFLOAT) (2.0 / lines);
+}
+
+static inline SPFLOAT output_gain(int lines)
+{
+    return (SPFLOAT) (outputGain * sqrt(8.0 / lines));
+}
+
+/* Added to the junction pressure with alternating sign on every sample, so
+   that the feedback loop settles around this level instead of decaying into
+   subnormal floats when the input goes silent. Far below audibility. */
+static const SPFLOAT antiDenormal = 1e-18;
+
+/* Control values for one block, dampFact and feedback move by their step on
+   every sample so that parameter changes are ramped across the block */
+
+typedef struct {
+    SPFLOAT dampFact, dampStep;
+    SPFLOAT feedback, feedbackStep;
+} revsc_ctl;
+
+/* One run of compute_block_tb(). The taps read for frames frames are stored
+   by frame, or by line with lineMajor set, the inputs to write for written
+   frames by frame. */
+
+typedef struct {
+    sp_revsc *p;
+    SPFLOAT *taps;
+    SPFLOAT *ains;
+    const int *bufferSize;
+    const int *bufferOffset;
+    uint32_t frames;
+    uint32_t written;
+    int lineMajor;
+} revsc_tb;
+
+#ifdef REVSC_SIMD
+
+/* Kernels are picked by the first sp_revsc_init(), instances can be created
+   on several threads at once */
+
+#ifdef _WIN32
+typedef INIT_ONCE revsc_once;
+#define REVSC_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+static BOOL CALLBACK run_once_callback(PINIT_ONCE once, PVOID init, PVOID *context)
+{
+    ((void (*)(void)) init)();
+    return TRUE;
+}
+
+static void run_once(revsc_once *once, void (*init)(void))
+{
+    InitOnceExecuteOnce(once, run_once_callback, (PVOID) init, NULL);
+}
+#else
+typedef pthread_once_t revsc_once;
+#define REVSC_ONCE_INIT PTHREAD_ONCE_INIT
+
+static void run_once(revsc_once *once, void (*init)(void))
+{
+    pthread_once(once, init);
+}
+#endif
+
+#endif /* REVSC_SIMD */
+
+/* sp_revsc holds cache line aligned members, malloc() only guarantees 16 */
+
+static void *aligned_malloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+#endif
+}
+
+static void aligned_free(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 int sp_revsc_create(sp_revsc **p){
-    *p = malloc(sizeof(sp_revsc));
+    *p = aligned_malloc(sizeof(sp_revsc), 64);
+    (*p)->iPow2Size = 0;
+    (*p)->iLines = 8;
+    (*p)->iMaxSampleRate = 0;
+    (*p)->interpolation = SP_REVSC_CUBIC;
+    (*p)->iStorage = SP_REVSC_FLOAT;
+    (*p)->prefetch = 0;
+    (*p)->timeBlocked = 0;
+    (*p)->iParallel = 0;
+    (*p)->parallel = NULL;
+    (*p)->parallelData = NULL;
+    (*p)->parallelAux.ptr = NULL;
     return SP_OK;
 }
 
-int sp_revsc_init(sp_data *sp, sp_revsc *p)
+/* everything sp_revsc_init() does except for allocating delay memory */
+
+static void init_params(sp_data *sp, sp_revsc *p)
 {
-    p->iSampleRate = sp->sr;
-    p->sampleRate = sp->sr;
     p->feedback = 0.97;
     p->lpfreq = 10000;
     p->iPitchMod = 1;
     p->iSkipInit = 0;
+    if (p->iLines != 4 && p->iLines != 16) p->iLines = 8;
+#ifdef REVSC_SIMD
+    select_kernels();
+#endif
+    if (p->iMaxSampleRate < sp->sr) p->iMaxSampleRate = sp->sr;
+}
+
+/* size of one delay line sample */
+
+static inline int sample_bytes(int storage)
+{
+    return storage == SP_REVSC_FLOAT ? (int) sizeof(SPFLOAT) : 2;
+}
+
+/* delay memory needed for rates up to iMaxSampleRate */
+
+static int revsc_bytes_alloc(sp_revsc *p)
+{
+    int i, nBytes = 0;
+    for(i = 0; i < p->iLines; i++){
+        nBytes += delay_line_bytes_alloc(p, p->iMaxSampleRate, i);
+    }
+    /* 16 bit samples are gathered with 32 bit loads */
+    if (p->iStorage != SP_REVSC_FLOAT) nBytes += sizeof(int32_t);
+    /* delay line state, see init_state() */
+    nBytes += DL_ALIGN - 1 + p->iLines * (sizeof(SPFLOAT) + 7 * sizeof(int));
+    return nBytes;
+}
+
+/* Point the delay line state into the cache line aligned end of aux */
+
+static void init_state(sp_revsc *p)
+{
+    sp_revsc_dl *lp = &p->delayLines;
+    uintptr_t end = (uintptr_t) p->aux.ptr + p->aux.size;
+    char *state;
+    int lines = p->iLines;
+
+    end -= lines * (sizeof(SPFLOAT) + 7 * sizeof(int));
+    state = (char *) (end & ~(uintptr_t) (DL_ALIGN - 1));
+    lp->filterState = (SPFLOAT *) state;
+    lp->writePos = (int *) (state + lines * sizeof(SPFLOAT));
+    lp->readPos = lp->writePos + lines;
+    lp->readPosFrac = lp->readPos + lines;
+    lp->readPosFrac_inc = lp->readPosFrac + lines;
+    lp->randLine_cnt = lp->readPosFrac_inc + lines;
+    lp->bufferSize = lp->randLine_cnt + lines;
+    lp->bufferOffset = lp->bufferSize + lines;
+}
+
+int sp_revsc_init(sp_data *sp, sp_revsc *p)
+{
+    init_params(sp, p);
+    sp_auxdata_alloc(&p->aux, revsc_bytes_alloc(p));
+    init_state(p);
+    if (p->iParallel) sp_revsc_init_parallel(p);
+
+    return sp_revsc_reset(sp, p);
+}
+
+/* Allocate the buffers needed by sp_revsc.parallel after sp_revsc_init(),
+   the same as setting iParallel before it. Does nothing if they are already
+   allocated. */
+
+int sp_revsc_init_parallel(sp_revsc *p)
+{
+    p->iParallel = 1;
+    if (p->parallelAux.ptr == NULL) {
+        sp_auxdata_alloc(&p->parallelAux, sizeof(SPFLOAT) * p->iLines
+                                          * (2 * TB_PARALLEL_FRAMES + 8));
+    }
+    return SP_OK;
+}
+
+static int revsc_layout(sp_data *sp, sp_revsc *p, int clear)
+{
+    if (sp->sr > p->iMaxSampleRate) return SP_NOT_OK;
+    p->iSampleRate = sp->sr;
+    p->sampleRate = sp->sr;
     p->dampFact = 1.0;
     p->prv_LPFreq = 0.0;
+    p->prv_Feedback = p->feedback;
+    p->prv_PitchMod = p->iPitchMod;
+    p->antiDenormal = antiDenormal;
     p->initDone = 1;
     int i, nBytes = 0;
-    for(i = 0; i < 8; i++){
-        nBytes += delay_line_bytes_alloc(sp->sr, 1, i);
-    }
-    sp_auxdata_alloc(&p->aux, nBytes);
-    nBytes = 0;
-    for (i = 0; i < 8; i++) {
-        p->delayLines[i].buf = (p->aux.ptr) + nBytes;
-        init_delay_line(p, &p->delayLines[i], i);
-        nBytes += delay_line_bytes_alloc(sp->sr, 1, i);
+    for (i = 0; i < p->iLines; i++) {
+        p->delayLines.bufferOffset[i] = nBytes / sample_bytes(p->iStorage) + DELAY_GUARD;
+        init_delay_line(p, i, clear);
+        nBytes += delay_line_bytes_alloc(p, sp->sr, i);
     }
+#ifdef REVSC_SIMD
+    p->rateVariant = rate_variant(p);
+#endif
 
     return SP_OK;
 }
 
+/* Lay out and clear the delay lines for sp->sr inside the memory allocated by
+   sp_revsc_init(), without allocating. Fails if sp->sr is above the rate the
+   memory was allocated for. */
+
+int sp_revsc_reset(sp_data *sp, sp_revsc *p)
+{
+    return revsc_layout(sp, p, 1);
+}
+
+/* Same as sp_revsc_reset() but the delay memory is left as it is, so that
+   the cost does not depend on its size. What remains of a tail is read back
+   at other positions, only for when it has already decayed. */
+
+int sp_revsc_relayout(sp_data *sp, sp_revsc *p)
+{
+    return revsc_layout(sp, p, 0);
+}
+
 
 int sp_revsc_destroy(sp_revsc **p)
 {
     sp_revsc *pp = *p;
     sp_auxdata_free(&pp->aux);
-    free(*p);
+    if (pp->parallelAux.ptr != NULL) sp_auxdata_free(&pp->parallelAux);
+    aligned_free(*p);
     return SP_OK;
 }
 
-static int delay_line_max_samples(SPFLOAT sr, SPFLOAT iPitchMod, int n)
+/* Most samples line n delays by at sr, for a variation scaled by iPitchMod */
+
+REVSC_SHARED
+int sp_revsc_line_samples(SPFLOAT sr, SPFLOAT iPitchMod, int n)
 {
     SPFLOAT maxDel;
 
-    maxDel = reverbParams[n][0];
-    maxDel += (reverbParams[n][1] * (SPFLOAT) iPitchMod * 1.125);
+    maxDel = sp_revsc_params[n][0];
+    maxDel += (sp_revsc_params[n][1] * (SPFLOAT) iPitchMod * 1.125);
     return (int) (maxDel * sr + 16.5);
 }
 
-static int delay_line_bytes_alloc(SPFLOAT sr, SPFLOAT iPitchMod, int n)
+/* sp_revsc_line_samples() or the next power of two if iPow2Size is set,
+   so that positions can wrap with a mask instead of a comparison */
+
+static int delay_line_buffer_size(sp_revsc *p, SPFLOAT sr, int n)
+{
+    int size = sp_revsc_line_samples(sr, 1, n);
+    int pow2 = 1;
+
+    if (!p->iPow2Size) return size;
+    while (pow2 < size) pow2 <<= 1;
+    return pow2;
+}
+
+static int delay_line_bytes_alloc(sp_revsc *p, SPFLOAT sr, int n)
 {
     int nBytes = 0;
 
-    nBytes += (delay_line_max_samples(sr, iPitchMod, n) * (int) sizeof(SPFLOAT));
+    nBytes += ((delay_line_buffer_size(p, sr, n) + 2 * DELAY_GUARD)
+               * sample_bytes(p->iStorage));
     return nBytes;
 }
 
-static void next_random_lineseg(sp_revsc *p, sp_revsc_dl *lp, int n)
+/* Largest absolute filter state, together with the output level this tells
+   whether the tail has decayed */
+
+SPFLOAT sp_revsc_peak(sp_revsc *p)
+{
+    SPFLOAT peak = 0, v;
+    int n;
+
+    for (n = 0; n < p->iLines; n++) {
+        v = fabs(p->delayLines.filterState[n]);
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+/* Upper bound of the delay time of any line in samples. Input takes at most
+   this long to reach the output. */
+
+int sp_revsc_max_delay(sp_revsc *p)
+{
+    int size = 0, n;
+
+    for (n = 0; n < p->iLines; n++) {
+        if (sp_revsc_line_samples(p->sampleRate, 1, n) > size)
+            size = sp_revsc_line_samples(p->sampleRate, 1, n);
+    }
+    return size;
+}
+
+#ifdef REVSC_SIMD
+
+/* Frames compute_block_tb() can run before a read reaches a sample written
+   in the same run, the shortest delay of any line less the taps after
+   readPos, at most limit. Segments are linear and end within the range of
+   the current iPitchMod, but start from the current delay, which is still
+   below that range for a while after iPitchMod is lowered. */
+
+static uint32_t tb_frames(sp_revsc *p, int limit)
+{
+    sp_revsc_dl *lp = &p->delayLines;
+    SPFLOAT minDel;
+    int64_t delay;
+    int frames = limit, minSamples, n;
+
+    for (n = 0; n < p->iLines; n++) {
+        minDel = sp_revsc_params[n][0] - sp_revsc_params[n][1] * (SPFLOAT) p->iPitchMod;
+        minSamples = (int) (minDel * p->sampleRate);
+        delay = ((int64_t) lp->writePos[n] - lp->readPos[n]) * DELAYPOS_SCALE
+                - lp->readPosFrac[n];
+        while (delay < 0)
+          delay += (int64_t) lp->bufferSize[n] * DELAYPOS_SCALE;
+        if ((int) (delay >> DELAYPOS_SHIFT) < minSamples)
+            minSamples = (int) (delay >> DELAYPOS_SHIFT);
+        if (minSamples - DELAY_GUARD - 2 < frames)
+            frames = minSamples - DELAY_GUARD - 2;
+    }
+    return frames > 1 ? (uint32_t) frames : 1;
+}
+
+#endif /* REVSC_SIMD */
+
+/* Append the next random line segment of line n to the ring. The delay at
+   its start is known exactly from the previous segment, as every sample the
+   write position moves by one and the read position by the increment. */
+
+/* Length of the next random line segment of line n and its read position
+   increment. The seed and the delay in 1/2^28 samples are updated to the end
+   of the segment. */
+
+REVSC_SHARED
+int sp_revsc_line_segment(SPFLOAT sr, SPFLOAT iPitchMod, int n, int *seed, int64_t *delay,
+                          int *inc)
 {
     SPFLOAT prvDel, nxtDel, phs_incVal;
+    int cnt;
 
     /* update random seed */
-    if (lp->seedVal < 0)
-      lp->seedVal += 0x10000;
-    lp->seedVal = (lp->seedVal * 15625 + 1) & 0xFFFF;
-    if (lp->seedVal >= 0x8000)
-      lp->seedVal -= 0x10000;
+    if (*seed < 0)
+      *seed += 0x10000;
+    *seed = (*seed * 15625 + 1) & 0xFFFF;
+    if (*seed >= 0x8000)
+      *seed -= 0x10000;
     /* length of next segment in samples */
-    lp->randLine_cnt = (int) ((p->sampleRate / reverbParams[n][2]) + 0.5);
-    prvDel = (SPFLOAT) lp->writePos;
-    prvDel -= ((SPFLOAT) lp->readPos
-               + ((SPFLOAT) lp->readPosFrac / (SPFLOAT) DELAYPOS_SCALE));
-    while (prvDel < 0.0)
-      prvDel += lp->bufferSize;
-    prvDel = prvDel / p->sampleRate;    /* previous delay time in seconds */
-    nxtDel = (SPFLOAT) lp->seedVal * reverbParams[n][1] / 32768.0;
+    cnt = (int) ((sr / sp_revsc_params[n][2]) + 0.5);
+    prvDel = (SPFLOAT) *delay / (SPFLOAT) DELAYPOS_SCALE;
+    prvDel = prvDel / sr;               /* previous delay time in seconds */
+    nxtDel = (SPFLOAT) *seed * sp_revsc_params[n][1] / 32768.0;
     /* next delay time in seconds */
-    nxtDel = reverbParams[n][0] + (nxtDel * (SPFLOAT) p->iPitchMod);
+    nxtDel = sp_revsc_params[n][0] + (nxtDel * (SPFLOAT) iPitchMod);
     /* calculate phase increment per sample */
-    phs_incVal = (prvDel - nxtDel) / (SPFLOAT) lp->randLine_cnt;
-    phs_incVal = phs_incVal * p->sampleRate + 1.0;
-    lp->readPosFrac_inc = (int) (phs_incVal * DELAYPOS_SCALE + 0.5);
+    phs_incVal = (prvDel - nxtDel) / (SPFLOAT) cnt;
+    phs_incVal = phs_incVal * sr + 1.0;
+    *inc = (int) (phs_incVal * DELAYPOS_SCALE + 0.5);
+    *delay += (int64_t) cnt * (DELAYPOS_SCALE - *inc);
+    return cnt;
 }
 
-static int init_delay_line(sp_revsc *p, sp_revsc_dl *lp, int n)
+static void next_random_lineseg(sp_revsc *p, int n)
 {
-    SPFLOAT readPos;
-    /* int     i; */
+    sp_revsc_seg *seg = &p->segments;
+    int slot = (seg->head[n] + seg->queued[n]) % SP_REVSC_SEGMENTS;
+
+    seg->seed[slot][n] = p->seedVal[n];
+    seg->count[slot][n] = sp_revsc_line_segment(p->sampleRate, p->iPitchMod, n,
+                                                &p->seedVal[n], &seg->delay[n],
+                                                &seg->inc[slot][n]);
+    seg->queued[n]++;
+}
+
+/* Top up the segment rings, called at control rate */
+
+static void schedule_random_linesegs(sp_revsc *p)
+{
+    int n;
+
+    for (n = 0; n < p->iLines; n++) {
+        while (p->segments.queued[n] < SP_REVSC_SEGMENTS)
+            next_random_lineseg(p, n);
+    }
+}
+
+/* Make the oldest queued segment of line n the current one */
+
+static inline void pop_random_lineseg(sp_revsc *p, sp_revsc_dl *lp, int n)
+{
+    sp_revsc_seg *seg = &p->segments;
+    int slot = seg->head[n];
+
+    lp->randLine_cnt[n] = seg->count[slot][n];
+    lp->readPosFrac_inc[n] = seg->inc[slot][n];
+    seg->head[n] = (slot + 1) % SP_REVSC_SEGMENTS;
+    seg->queued[n]--;
+}
+
+/* Frames line n can run before it needs a segment that is not queued yet */
+
+static int scheduled_frames(sp_revsc *p, int n)
+{
+    sp_revsc_seg *seg = &p->segments;
+    int k, frames = p->delayLines.randLine_cnt[n] - 1;
+
+    for (k = 0; k < seg->queued[n]; k++)
+        frames += seg->count[(seg->head[n] + k) % SP_REVSC_SEGMENTS][n];
+    return frames;
+}
+
+/* Drop the queued segments of line n and start a new one from the delay at
+   the current read and write positions */
+
+static void restart_random_lineseg(sp_revsc *p, int n)
+{
+    sp_revsc_dl *lp = &p->delayLines;
+    sp_revsc_seg *seg = &p->segments;
+
+    seg->head[n] = 0;
+    seg->queued[n] = 0;
+    seg->delay[n] = ((int64_t) lp->writePos[n] - lp->readPos[n])
+                    * DELAYPOS_SCALE - lp->readPosFrac[n];
+    while (seg->delay[n] < 0)
+      seg->delay[n] += (int64_t) lp->bufferSize[n] * DELAYPOS_SCALE;
+    next_random_lineseg(p, n);
+    pop_random_lineseg(p, lp, n);
+}
+
+/* Seed and read position of line n before the first frame, for a buffer
+   of bufferSize samples written from 0 */
+
+REVSC_SHARED
+void sp_revsc_line_start(SPFLOAT sr, SPFLOAT iPitchMod, int n, int bufferSize, int *seed,
+                         int *readPos, int *readPosFrac)
+{
+    SPFLOAT pos;
 
-    /* calculate length of delay line */
-    lp->bufferSize = delay_line_max_samples(p->sampleRate, 1, n);
-    lp->dummy = 0;
-    lp->writePos = 0;
     /* set random seed */
-    lp->seedVal = (int) (reverbParams[n][3] + 0.5);
+    *seed = (int) (sp_revsc_params[n][3] + 0.5);
     /* set initial delay time */
-    readPos = (SPFLOAT) lp->seedVal * reverbParams[n][1] / 32768;
-    readPos = reverbParams[n][0] + (readPos * (SPFLOAT) p->iPitchMod);
-    readPos = (SPFLOAT) lp->bufferSize - (readPos * p->sampleRate);
-    lp->readPos = (int) readPos;
-    readPos = (readPos - (SPFLOAT) lp->readPos) * (SPFLOAT) DELAYPOS_SCALE;
-    lp->readPosFrac = (int) (readPos + 0.5);
-    /* initialise first random line segment */
-    next_random_lineseg(p, lp, n);
+    pos = (SPFLOAT) *seed * sp_revsc_params[n][1] / 32768;
+    pos = sp_revsc_params[n][0] + (pos * (SPFLOAT) iPitchMod);
+    pos = (SPFLOAT) bufferSize - (pos * sr);
+    *readPos = (int) pos;
+    pos = (pos - (SPFLOAT) *readPos) * (SPFLOAT) DELAYPOS_SCALE;
+    *readPosFrac = (int) (pos + 0.5);
+}
+
+static int init_delay_line(sp_revsc *p, int n, int clear)
+{
+    sp_revsc_dl *lp = &p->delayLines;
+    /* int     i; */
+
+    /* calculate length of delay line */
+    lp->bufferSize[n] = delay_line_buffer_size(p, p->sampleRate, n);
+    lp->writePos[n] = 0;
+    sp_revsc_line_start(p->sampleRate, p->iPitchMod, n, lp->bufferSize[n], &p->seedVal[n],
+                        &lp->readPos[n], &lp->readPosFrac[n]);
+    /* initialise random line segments from the current delay */
+    restart_random_lineseg(p, n);
+    lp->filterState[n] = 0.0;
     /* clear delay line to zero */
-    lp->filterState = 0.0;
-    memset(lp->buf, 0, sizeof(SPFLOAT) * lp->bufferSize);
+    if (clear) {
+        memset((char *) p->aux.ptr + (lp->bufferOffset[n] - DELAY_GUARD) * sample_bytes(p->iStorage),
+               0, sample_bytes(p->iStorage) * (lp->bufferSize[n] + 2 * DELAY_GUARD));
+    }
     return SP_OK;
 }
 
 
-int sp_revsc_compute(sp_data *sp, sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2, SPFLOAT *out1, SPFLOAT *out2)
+#ifndef REVSC_SIMD
+
+/* Delay line sample i, see encode_taps() and decode_taps() for the 16 bit
+   formats */
+
+static SPFLOAT load_sample(const void *mem, int i, int storage)
 {
+    union { float f; int32_t i; } u;
+    int32_t w;
+
+    if (storage == SP_REVSC_FLOAT) return ((const SPFLOAT *) mem)[i];
+    if (storage == SP_REVSC_INT16) {
+        return ((const int16_t *) mem)[i] * (SPFLOAT) (1.0 / INT16_SCALE);
+    }
+    w = ((const uint16_t *) mem)[i];
+    if ((w & 0x7FFF) < 0x400) {
+        u.f = (w & 0x3FF) * (1.0f / 16777216.0f);
+    } else {
+        u.i = ((w & 0x7FFF) << 13) + (112 << 23);
+    }
+    u.i |= (w & 0x8000) << 16;
+    return u.f;
+}
+
+static void store_sample(void *mem, int i, SPFLOAT v, int storage)
+{
+    union { float f; int32_t i; } u;
+    int32_t w, mag;
+
+    if (storage == SP_REVSC_FLOAT) {
+        ((SPFLOAT *) mem)[i] = v;
+        return;
+    }
+    if (storage == SP_REVSC_INT16) {
+        v = floor(v * INT16_SCALE + 0.5);
+        ((int16_t *) mem)[i] = v > 32767 ? 32767 : (v < -32767 ? -32767 : (int16_t) v);
+        return;
+    }
+    u.f = (float) v;
+    mag = u.i & 0x7FFFFFFF;
+    if (mag < (113 << 23)) {
+        w = (int32_t) floor(fabs(v) * 16777216.0 + 0.5);
+    } else {
+        w = (mag - (112 << 23) + 0x1000) >> 13;
+        if (w > 0x7BFF) w = 0x7BFF;
+    }
+    ((uint16_t *) mem)[i] = (uint16_t) (w | ((u.i >> 16) & 0x8000));
+}
+
+/* Reference implementation, one delay line at a time */
+
+static void compute_block_scalar(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+                                 SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes,
+                                 const revsc_ctl *ctl)
+{
+    SPFLOAT dampFact = ctl->dampFact;
+    SPFLOAT feedback = ctl->feedback;
     SPFLOAT ainL, ainR, aoutL, aoutR;
-    SPFLOAT vm1, v0, v1, v2, am1, a0, a1, a2, frac;
-    sp_revsc_dl *lp;
-    int readPos;
-    uint32_t n;
-    int bufferSize; /* Local copy */
-    SPFLOAT dampFact = p->dampFact;
+    SPFLOAT v0, frac, am1, a0, a1, a2;
+    void *mem = p->aux.ptr;
+    int storage = p->iStorage;
+    int interpolation = p->interpolation;
+    uint32_t lines = p->iLines;
+    SPFLOAT jpScale = junction_scale(lines);
+    SPFLOAT gain = output_gain(lines);
+    SPFLOAT dn = p->antiDenormal;
+    int readPos, writePos;
+    uint32_t i, n;
+    int bufferSize, offset;
 
-    if (p->initDone <= 0) return SP_NOT_OK;
+    /* local copy of the delay line state at fixed offsets, writePos to
+       randLine_cnt are consecutive in the state block */
+
+    SPFLOAT filterState[SP_REVSC_MAX_LINES];
+    int state[5][SP_REVSC_MAX_LINES];
+    sp_revsc_dl dl = p->delayLines;
+
+    memcpy(filterState, dl.filterState, lines * sizeof(SPFLOAT));
+    for (n = 0; n < 5; n++) {
+        memcpy(state[n], dl.writePos + n * lines, lines * sizeof(int));
+    }
+    dl.filterState = filterState;
+    dl.writePos = state[0];
+    dl.readPos = state[1];
+    dl.readPosFrac = state[2];
+    dl.readPosFrac_inc = state[3];
+    dl.randLine_cnt = state[4];
+
+    for (i = 0; i < nframes; i++) {
+        dampFact += ctl->dampStep;
+        feedback += ctl->feedbackStep;
+
+        /* calculate "resultant junction pressure" and mix to input signals */
+
+        ainL = aoutL = aoutR = 0.0;
+        for (n = 0; n < lines; n++) {
+            ainL += dl.filterState[n];
+        }
+        ainL = ainL * jpScale + dn;
+        dn = -dn;
+        ainR = ainL + in2[i];
+        ainL = ainL + in1[i];
+
+        /* loop through all delay lines */
+
+        for (n = 0; n < lines; n++) {
+            offset = dl.bufferOffset[n];
+            bufferSize = dl.bufferSize[n];
+
+            /* send input signal and feedback to delay line, samples near
+               either end are also written to the guard at the other end */
+
+            v0 = (SPFLOAT) ((n & 1 ? ainR : ainL) - dl.filterState[n]);
+            writePos = dl.writePos[n];
+            store_sample(mem, offset + writePos, v0, storage);
+            writePos += (bufferSize & -(writePos < DELAY_GUARD))
+                        - (bufferSize & -(writePos >= bufferSize - DELAY_GUARD));
+            store_sample(mem, offset + writePos, v0, storage);
+            writePos = dl.writePos[n] + 1;
+            dl.writePos[n] = writePos - (bufferSize & -(writePos >= bufferSize));
+
+            /* advance read position */
+
+            readPos = dl.readPos[n] + (dl.readPosFrac[n] >> DELAYPOS_SHIFT);
+            dl.readPosFrac[n] &= DELAYPOS_MASK;
+            readPos -= bufferSize & -(readPos >= bufferSize);
+            dl.readPos[n] = readPos;
+
+            /* read from delay line with cubic, linear or no interpolation */
+
+            if (interpolation == SP_REVSC_CUBIC) {
+                frac = (SPFLOAT) dl.readPosFrac[n] * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                a2 = frac * frac; a2 -= 1; a2 *= (SPFLOAT) (1.0 / 6.0);
+                a1 = frac; a1 += 1; a1 *= (SPFLOAT) 0.5; am1 = a1 - 1;
+                a0 = 3 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
+                readPos += offset;
+                v0 = load_sample(mem, readPos, storage);
+                v0 = (am1 * load_sample(mem, readPos - 1, storage) + a0 * v0
+                      + a1 * load_sample(mem, readPos + 1, storage)
+                      + a2 * load_sample(mem, readPos + 2, storage)) * frac + v0;
+            } else if (interpolation == SP_REVSC_LINEAR) {
+                frac = (SPFLOAT) dl.readPosFrac[n] * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                readPos += offset;
+                v0 = load_sample(mem, readPos, storage);
+                v0 += (load_sample(mem, readPos + 1, storage) - v0) * frac;
+            } else {
+                v0 = load_sample(mem, readPos + offset, storage);
+            }
+
+            /* update buffer read position */
+
+            dl.readPosFrac[n] += dl.readPosFrac_inc[n];
+
+            /* apply feedback gain and lowpass filter */
+
+            v0 *= feedback;
+            v0 = (dl.filterState[n] - v0) * dampFact + v0;
+            dl.filterState[n] = v0;
+
+            /* mix to output */
+
+            if (n & 1) {
+                aoutR += v0;
+            }else{
+                aoutL += v0;
+            }
+
+            /* start next random line segment if current one has reached endpoint */
+
+            if (--(dl.randLine_cnt[n]) <= 0) {
+                pop_random_lineseg(p, &dl, n);
+            }
+        }
+        /* someday, use aoutR for multimono out */
+
+        out1[i] = aoutL * gain;
+        out2[i] = aoutR * gain;
+    }
+
+    memcpy(p->delayLines.filterState, filterState, lines * sizeof(SPFLOAT));
+    for (n = 0; n < 5; n++) {
+        memcpy(p->delayLines.writePos + n * lines, state[n], lines * sizeof(int));
+    }
+    p->antiDenormal = dn;
+}
+
+#endif /* !REVSC_SIMD */
+
+#ifdef REVSC_SIMD
+
+/* per lane control values of the sp_revsc_bank kernels, see revsc_ctl */
+
+typedef struct {
+    revsc_vf_8 dampFact, dampStep;
+    revsc_vf_8 feedback, feedbackStep;
+} revsc_bank_ctl;
+
+typedef void (*compute_block_func)(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+                                   SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes,
+                                   const revsc_ctl *ctl);
+
+typedef void (*compute_bank_func)(sp_revsc_bank *b, const int first,
+                                  SPFLOAT **in1, SPFLOAT **in2,
+                                  SPFLOAT **out1, SPFLOAT **out2,
+                                  uint32_t start, uint32_t nframes,
+                                  const revsc_bank_ctl *ctl);
+
+/* Kernels built for one instruction set. For 8 lines block is indexed by
+   [rateVariant][iPow2Size][interp_variant(interpolation)] and used for
+   SP_REVSC_FLOAT storage, packed by [iStorage - 1][iPow2Size][...] for the
+   16 bit formats. lines holds the 4 and 16 line kernels, indexed by
+   [iLines == 16][iStorage][iPow2Size][...]. tb holds the time blocked
+   kernels of all sizes by [iLines / 8][iStorage][iPow2Size][...]. bank is
+   indexed by [iStorage][iPow2Size][...] and runs members of 8 lines. Lanes
+   across bank members only pay off with hardware gathers, without them bank
+   is all NULL. */
+
+#define INTERP_VARIANTS 3
 
-    /* calculate tone filter coefficient if frequency changed */
+typedef struct {
+    const char *name;
+    compute_block_func block[RATE_VARIANTS][2][INTERP_VARIANTS];
+    compute_block_func packed[2][2][INTERP_VARIANTS];
+    compute_block_func lines[2][3][2][INTERP_VARIANTS];
+    compute_block_func tb[3][3][2][INTERP_VARIANTS];
+    compute_bank_func bank[3][2][INTERP_VARIANTS];
+} revsc_kernels;
+
+static inline int interp_variant(int interpolation)
+{
+    return interpolation == SP_REVSC_CUBIC ? 2 : interpolation == SP_REVSC_LINEAR;
+}
+
+/* revsc_kernel.h is included once per instruction set, REVSC_ISA is appended
+   to the names it defines. It includes revsc_lanes.h once per number of
+   lines, which inserts REVSC_LANES before REVSC_ISA. */
+
+#define REVSC_KERNEL(name) REVSC_PASTE(name, REVSC_ISA)
+#define REVSC_LANE(name) REVSC_KERNEL(REVSC_PASTE(name, REVSC_LANES))
+#define REVSC_PASTE(name, isa) REVSC_PASTE_(name, isa)
+#define REVSC_PASTE_(name, isa) name##_##isa
+#define REVSC_STR(isa) REVSC_STR_(isa)
+#define REVSC_STR_(isa) #isa
+
+/* compute_block_simd() or compute_block_tb() specialized for each rate,
+   buffer layout and interpolation, for REVSC_LANES lines */
+
+#define SIMD_VARIANT(name, kernel, rate, storage, pow2, interpolation) \
+static void REVSC_LANE(name)(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2, \
+                             SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes, \
+                             const revsc_ctl *ctl) \
+{ \
+    REVSC_LANE(kernel)(p, in1, in2, out1, out2, nframes, ctl, \
+                       rate, storage, pow2, interpolation); \
+}
+
+#define SIMD_LAYOUT_VARIANTS(name, kernel, rate, storage) \
+SIMD_VARIANT(name##_exact_none,   kernel, rate, storage, 0, SP_REVSC_NONE) \
+SIMD_VARIANT(name##_exact_linear, kernel, rate, storage, 0, SP_REVSC_LINEAR) \
+SIMD_VARIANT(name##_exact_cubic,  kernel, rate, storage, 0, SP_REVSC_CUBIC) \
+SIMD_VARIANT(name##_pow2_none,    kernel, rate, storage, 1, SP_REVSC_NONE) \
+SIMD_VARIANT(name##_pow2_linear,  kernel, rate, storage, 1, SP_REVSC_LINEAR) \
+SIMD_VARIANT(name##_pow2_cubic,   kernel, rate, storage, 1, SP_REVSC_CUBIC)
+
+#define SIMD_LAYOUT_ROW(name, lanes) { \
+    { REVSC_KERNEL(name##_exact_none_##lanes), \
+      REVSC_KERNEL(name##_exact_linear_##lanes), \
+      REVSC_KERNEL(name##_exact_cubic_##lanes) }, \
+    { REVSC_KERNEL(name##_pow2_none_##lanes), \
+      REVSC_KERNEL(name##_pow2_linear_##lanes), \
+      REVSC_KERNEL(name##_pow2_cubic_##lanes) } }
+
+/* rates are only specialized for 8 lines */
+
+#define SIMD_RATE_VARIANTS(rate) \
+SIMD_LAYOUT_VARIANTS(compute_block_simd_##rate, compute_block_simd, rate, SP_REVSC_FLOAT)
+
+#define SIMD_RATE_ROW(rate) SIMD_LAYOUT_ROW(compute_block_simd_##rate, 8)
+
+/* the other storage formats and network sizes use the generic layout */
+
+#define SIMD_STORAGE_VARIANTS(format, storage) \
+SIMD_LAYOUT_VARIANTS(compute_block_simd_##format, compute_block_simd, 0, storage)
+
+#define SIMD_STORAGE_ROW(format, lanes) SIMD_LAYOUT_ROW(compute_block_simd_##format, lanes)
+
+/* Time blocked kernels, generic layout only, each with its tb_task() for
+   sp_revsc.parallel */
+
+#define TB_VARIANT(name, storage, pow2, interpolation) \
+static void REVSC_LANE(name##_task)(void *arg, int n) \
+{ \
+    REVSC_LANE(tb_task)(arg, n, storage, pow2, interpolation); \
+} \
+static void REVSC_LANE(name)(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2, \
+                             SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes, \
+                             const revsc_ctl *ctl) \
+{ \
+    REVSC_LANE(compute_block_tb)(p, in1, in2, out1, out2, nframes, ctl, \
+                                 REVSC_LANE(name##_task), storage, pow2, \
+                                 interpolation); \
+}
+
+#define TB_STORAGE_VARIANTS(format, storage) \
+TB_VARIANT(compute_block_tb_##format##_exact_none,   storage, 0, SP_REVSC_NONE) \
+TB_VARIANT(compute_block_tb_##format##_exact_linear, storage, 0, SP_REVSC_LINEAR) \
+TB_VARIANT(compute_block_tb_##format##_exact_cubic,  storage, 0, SP_REVSC_CUBIC) \
+TB_VARIANT(compute_block_tb_##format##_pow2_none,    storage, 1, SP_REVSC_NONE) \
+TB_VARIANT(compute_block_tb_##format##_pow2_linear,  storage, 1, SP_REVSC_LINEAR) \
+TB_VARIANT(compute_block_tb_##format##_pow2_cubic,   storage, 1, SP_REVSC_CUBIC)
+
+#define TB_STORAGE_ROW(format, lanes) SIMD_LAYOUT_ROW(compute_block_tb_##format, lanes)
+
+#define TB_LINES_ROW(lanes) { \
+    TB_STORAGE_ROW(float, lanes), TB_STORAGE_ROW(half, lanes), TB_STORAGE_ROW(int16, lanes) }
+
+#define BANK_VARIANT(name, storage, pow2, interpolation) \
+static void REVSC_KERNEL(name)(sp_revsc_bank *b, const int first, \
+                               SPFLOAT **in1, SPFLOAT **in2, SPFLOAT **out1, SPFLOAT **out2, \
+                               uint32_t start, uint32_t nframes, const revsc_bank_ctl *ctl) \
+{ \
+    REVSC_KERNEL(compute_bank_simd)(b, first, in1, in2, out1, out2, start, nframes, \
+                                    ctl, storage, pow2, interpolation); \
+}
+
+#define BANK_STORAGE_VARIANTS(format, storage) \
+BANK_VARIANT(compute_bank_simd_##format##_exact_none,   storage, 0, SP_REVSC_NONE) \
+BANK_VARIANT(compute_bank_simd_##format##_exact_linear, storage, 0, SP_REVSC_LINEAR) \
+BANK_VARIANT(compute_bank_simd_##format##_exact_cubic,  storage, 0, SP_REVSC_CUBIC) \
+BANK_VARIANT(compute_bank_simd_##format##_pow2_none,    storage, 1, SP_REVSC_NONE) \
+BANK_VARIANT(compute_bank_simd_##format##_pow2_linear,  storage, 1, SP_REVSC_LINEAR) \
+BANK_VARIANT(compute_bank_simd_##format##_pow2_cubic,   storage, 1, SP_REVSC_CUBIC)
+
+#define BANK_STORAGE_ROW(format) { \
+    { REVSC_KERNEL(compute_bank_simd_##format##_exact_none), \
+      REVSC_KERNEL(compute_bank_simd_##format##_exact_linear), \
+      REVSC_KERNEL(compute_bank_simd_##format##_exact_cubic) }, \
+    { REVSC_KERNEL(compute_bank_simd_##format##_pow2_none), \
+      REVSC_KERNEL(compute_bank_simd_##format##_pow2_linear), \
+      REVSC_KERNEL(compute_bank_simd_##format##_pow2_cubic) } }
+
+/* baseline, whatever the compiler flags allow */
+
+#define REVSC_ISA generic
+#if defined(__AVX2__)
+#define REVSC_ISA_GATHER 1
+#else
+#define REVSC_ISA_GATHER 0
+#endif
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+#define REVSC_ISA_SCATTER 1
+#else
+#define REVSC_ISA_SCATTER 0
+#endif
+#if defined(__F16C__)
+#define REVSC_ISA_F16C 1
+#else
+#define REVSC_ISA_F16C 0
+#endif
+#include "revsc_kernel.h"
+
+#ifdef REVSC_DISPATCH
+
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+#endif
+#define REVSC_ISA avx2
+#define REVSC_ISA_GATHER 1
+#define REVSC_ISA_SCATTER 0
+#define REVSC_ISA_F16C 1
+#include "revsc_kernel.h"
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx512f,avx512vl,avx2,fma,f16c"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl,avx2,fma,f16c")
+#endif
+#define REVSC_ISA avx512
+#define REVSC_ISA_GATHER 1
+#define REVSC_ISA_SCATTER 1
+#define REVSC_ISA_F16C 1
+#include "revsc_kernel.h"
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif /* REVSC_DISPATCH */
+
+static const revsc_kernels *kernels = NULL; /* picked by the first sp_revsc_init() */
+static revsc_once kernelsOnce = REVSC_ONCE_INIT;
+
+/* Use the best kernels the CPU supports. SP_REVSC_ISA in the environment can
+   force generic, avx2 or avx512 for testing, as long as the CPU supports it. */
+
+static void pick_kernels(void)
+{
+#ifdef REVSC_DISPATCH
+    const char *isa = getenv("SP_REVSC_ISA");
+#endif
+
+    kernels = &kernels_generic;
+#ifdef REVSC_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+        && __builtin_cpu_supports("f16c")
+        && (isa == NULL || strcmp(isa, kernels_avx2.name) == 0))
+        kernels = &kernels_avx2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+        && __builtin_cpu_supports("f16c")
+        && (isa == NULL || strcmp(isa, kernels_avx512.name) == 0))
+        kernels = &kernels_avx512;
+#endif
+}
+
+static void select_kernels(void)
+{
+    run_once(&kernelsOnce, pick_kernels);
+}
+
+#endif /* REVSC_SIMD */
+
+int sp_revsc_compute(sp_data *sp, sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2, SPFLOAT *out1, SPFLOAT *out2)
+{
+    return sp_revsc_compute_block(sp, p, in1, in2, out1, out2, 1);
+}
+
+/* Control values for the next nframes, p keeps the targets they ramp to */
+
+static void block_ctl(sp_revsc *p, uint32_t nframes, revsc_ctl *ctl)
+{
+    SPFLOAT dampFact = p->dampFact;
+    int n;
+
+    /* calculate tone filter coefficient if frequency changed, once per block */
 
     if (p->lpfreq != p->prv_LPFreq) {
+        dampFact = 2.0 - cos(p->lpfreq * (2 * M_PI) / p->sampleRate);
+        dampFact = dampFact - sqrt(dampFact * dampFact - 1.0);
+
+        /* first block after a reset starts at the targets, nothing to ramp */
+
+        if (p->prv_LPFreq == 0.0) {
+            p->dampFact = dampFact;
+            p->prv_Feedback = p->feedback;
+        }
         p->prv_LPFreq = p->lpfreq;
-        dampFact = 2.0 - cos(p->prv_LPFreq * (2 * M_PI) / p->sampleRate);
-        dampFact = p->dampFact = dampFact - sqrt(dampFact * dampFact - 1.0);
     }
 
-    /* calculate "resultant junction pressure" and mix to input signals */
+    /* a new modulation depth applies from the current delays on, instead of
+       after the segments that are already queued */
 
-    ainL = aoutL = aoutR = 0.0;
-    for (n = 0; n < 8; n++) {
-        ainL += p->delayLines[n].filterState;
+    if (p->iPitchMod != p->prv_PitchMod) {
+        for (n = 0; n < p->iLines; n++) {
+            /* the random sequence goes on from the current segment, as if
+               the dropped ones had never been queued */
+            if (p->segments.queued[n] > 0)
+                p->seedVal[n] = p->segments.seed[p->segments.head[n]][n];
+            restart_random_lineseg(p, n);
+        }
+        p->prv_PitchMod = p->iPitchMod;
     }
-    ainL *= jpScale;
-    ainR = ainL + *in2;
-    ainL = ainL + *in1;
 
-    /* loop through all delay lines */
+    /* ramp from the values reached by the previous block to the new targets */
 
-    for (n = 0; n < 8; n++) {
-        lp = &p->delayLines[n];
-        bufferSize = lp->bufferSize;
+    ctl->dampStep = (dampFact - p->dampFact) / nframes;
+    ctl->dampFact = p->dampFact;
+    ctl->feedbackStep = (p->feedback - p->prv_Feedback) / nframes;
+    ctl->feedback = p->prv_Feedback;
+
+    p->dampFact = dampFact;
+    p->prv_Feedback = p->feedback;
+}
+
+/* Frames all lines of p can run with the segments queued after topping up
+   the rings, at most nframes */
+
+static uint32_t schedule_block(sp_revsc *p, uint32_t nframes)
+{
+    int n;
+
+    schedule_random_linesegs(p);
+    for (n = 0; n < p->iLines; n++) {
+        if ((uint32_t) scheduled_frames(p, n) < nframes)
+            nframes = scheduled_frames(p, n);
+    }
+    return nframes;
+}
+
+/* Same as sp_revsc_compute() but for nframes samples per call. The delay line
+   state is kept in locals for the whole block and written back once at the
+   end. Input and output buffers may point to the same memory. */
+
+int sp_revsc_compute_block(sp_data *sp, sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+                           SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes)
+{
+    revsc_ctl ctl;
+
+    if (p->initDone <= 0) return SP_NOT_OK;
+    if (nframes == 0) return SP_OK;
+
+    block_ctl(p, nframes, &ctl);
+
+    /* queue upcoming random line segments, the kernels only consume them.
+       A full ring covers far more than a typical block, longer blocks are
+       split where a line would run out. */
+
+    while (nframes > 0) {
+        uint32_t chunk = schedule_block(p, nframes);
+
+#ifdef REVSC_SIMD
+        if (p->timeBlocked) {
+            kernels->tb[p->iLines / 8][p->iStorage][p->iPow2Size != 0]
+                       [interp_variant(p->interpolation)](
+                p, in1, in2, out1, out2, chunk, &ctl);
+        } else if (p->iLines != 8) {
+            kernels->lines[p->iLines == 16][p->iStorage][p->iPow2Size != 0]
+                          [interp_variant(p->interpolation)](
+                p, in1, in2, out1, out2, chunk, &ctl);
+        } else if (p->iStorage == SP_REVSC_FLOAT) {
+            kernels->block[p->rateVariant][p->iPow2Size != 0]
+                          [interp_variant(p->interpolation)](
+                p, in1, in2, out1, out2, chunk, &ctl);
+        } else {
+            kernels->packed[p->iStorage - 1][p->iPow2Size != 0]
+                           [interp_variant(p->interpolation)](
+                p, in1, in2, out1, out2, chunk, &ctl);
+        }
+#else
+        compute_block_scalar(p, in1, in2, out1, out2, chunk, &ctl);
+#endif
+
+        ctl.dampFact += ctl.dampStep * chunk;
+        ctl.feedback += ctl.feedbackStep * chunk;
+        in1 += chunk; in2 += chunk;
+        out1 += chunk; out2 += chunk;
+        nframes -= chunk;
+    }
+
+    return SP_OK;
+}
+
+/* Bank of reverbs */
+
+#define BANK_ALIGN 64
+
+static int bank_bytes_alloc(sp_revsc *p)
+{
+    return (revsc_bytes_alloc(p) + BANK_ALIGN - 1) & ~(BANK_ALIGN - 1);
+}
+
+int sp_revsc_bank_create(sp_revsc_bank **p, int size)
+{
+    int i;
+
+    *p = malloc(sizeof(sp_revsc_bank));
+    (*p)->size = size;
+    (*p)->revsc = malloc(sizeof(sp_revsc *) * size);
+    (*p)->interpolation = SP_REVSC_CUBIC;
+    (*p)->iPow2Size = 0;
+    (*p)->iLines = 8;
+    (*p)->iMaxSampleRate = 0;
+    (*p)->iStorage = SP_REVSC_FLOAT;
+    (*p)->prefetch = SP_REVSC_PREFETCH;
+    (*p)->initDone = 0;
+    (*p)->aux.ptr = NULL;
+    for (i = 0; i < size; i++) {
+        sp_revsc_create(&(*p)->revsc[i]);
+    }
+    return SP_OK;
+}
+
+int sp_revsc_bank_destroy(sp_revsc_bank **p)
+{
+    sp_revsc_bank *pp = *p;
+    int i;
+
+    /* member delay memory is part of the bank allocation */
+    for (i = 0; i < pp->size; i++) {
+        aligned_free(pp->revsc[i]);
+    }
+    if (pp->aux.ptr != NULL) sp_auxdata_free(&pp->aux);
+    free(pp->revsc);
+    free(pp);
+    return SP_OK;
+}
+
+int sp_revsc_bank_init(sp_data *sp, sp_revsc_bank *p)
+{
+    sp_revsc *m;
+    size_t nBytes = 0;
+    int i;
+
+    for (i = 0; i < p->size; i++) {
+        m = p->revsc[i];
+        m->interpolation = p->interpolation;
+        m->iPow2Size = p->iPow2Size;
+        m->iLines = p->iLines;
+        m->iStorage = p->iStorage;
+        m->iMaxSampleRate = p->iMaxSampleRate;
+        m->prefetch = p->prefetch;
+        init_params(sp, m);
+        nBytes += bank_bytes_alloc(m);
+    }
+
+    /* one extra BANK_ALIGN so that members start on cache lines */
+    sp_auxdata_alloc(&p->aux, nBytes + BANK_ALIGN);
+
+    nBytes = (BANK_ALIGN - ((uintptr_t) p->aux.ptr & (BANK_ALIGN - 1))) & (BANK_ALIGN - 1);
+    for (i = 0; i < p->size; i++) {
+        m = p->revsc[i];
+        m->aux.ptr = (char *) p->aux.ptr + nBytes;
+        m->aux.size = revsc_bytes_alloc(m);
+        init_state(m);
+        nBytes += bank_bytes_alloc(m);
+    }
+    return sp_revsc_bank_reset(sp, p);
+}
+
+int sp_revsc_bank_reset(sp_data *sp, sp_revsc_bank *p)
+{
+    int i;
+
+    p->initDone = 0;
+    for (i = 0; i < p->size; i++) {
+        if (sp_revsc_reset(sp, p->revsc[i]) != SP_OK) return SP_NOT_OK;
+    }
+    p->initDone = 1;
+    return SP_OK;
+}
 
-        /* send input signal and feedback to delay line */
+/* Same as sp_revsc_compute_block() for every member, inN[i] and outN[i] are
+   the buffers of member i. Groups of 8 members are processed together, one
+   per lane, so that every gather reads the same line of 8 members. */
 
-        lp->buf[lp->writePos] = (SPFLOAT) ((n & 1 ? ainR : ainL)
-                                 - lp->filterState);
-        if (++lp->writePos >= bufferSize) {
-            lp->writePos -= bufferSize;
+int sp_revsc_bank_compute_block(sp_data *sp, sp_revsc_bank *p, SPFLOAT **in1, SPFLOAT **in2,
+                                SPFLOAT **out1, SPFLOAT **out2, uint32_t nframes)
+{
+    int first = 0;
+#ifdef REVSC_SIMD
+    compute_bank_func bank;
+    revsc_bank_ctl bctl;
+    revsc_ctl ctl;
+    uint32_t start, chunk;
+    int l;
+#endif
+
+    if (p->initDone <= 0) return SP_NOT_OK;
+    if (nframes == 0) return SP_OK;
+
+#ifdef REVSC_SIMD
+    bank = p->iLines != 8 ? NULL
+         : kernels->bank[p->iStorage][p->iPow2Size != 0][interp_variant(p->interpolation)];
+    for (; bank != NULL && first + 8 <= p->size; first += 8) {
+        for (l = 0; l < 8; l++) {
+            block_ctl(p->revsc[first + l], nframes, &ctl);
+            bctl.dampFact[l] = ctl.dampFact;
+            bctl.dampStep[l] = ctl.dampStep;
+            bctl.feedback[l] = ctl.feedback;
+            bctl.feedbackStep[l] = ctl.feedbackStep;
         }
 
-        /* read from delay line with cubic interpolation */
+        for (start = 0; start < nframes; start += chunk) {
+            chunk = nframes - start;
+            for (l = 0; l < 8; l++) {
+                chunk = schedule_block(p->revsc[first + l], chunk);
+            }
+
+            bank(p, first, in1, in2, out1, out2, start, chunk, &bctl);
 
-        if (lp->readPosFrac >= DELAYPOS_SCALE) {
-            lp->readPos += (lp->readPosFrac >> DELAYPOS_SHIFT);
-            lp->readPosFrac &= DELAYPOS_MASK;
+            bctl.dampFact += bctl.dampStep * (SPFLOAT) chunk;
+            bctl.feedback += bctl.feedbackStep * (SPFLOAT) chunk;
         }
-        if (lp->readPos >= bufferSize)
-        lp->readPos -= bufferSize;
-        readPos = lp->readPos;
-        frac = (SPFLOAT) lp->readPosFrac * (1.0 / (SPFLOAT) DELAYPOS_SCALE);
+    }
+#endif
 
-        /* calculate interpolation coefficients */
+    /* remaining members, a partial group is not faster than running them
+       one by one, neither are groups without hardware gathers or with other
+       than 8 lines */
 
-        a2 = frac * frac; a2 -= 1.0; a2 *= (1.0 / 6.0);
-        a1 = frac; a1 += 1.0; a1 *= 0.5; am1 = a1 - 1.0;
-        a0 = 3.0 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
+    for (; first < p->size; first++) {
+        sp_revsc_compute_block(sp, p->revsc[first], in1[first], in2[first],
+                               out1[first], out2[first], nframes);
+    }
+    return SP_OK;
+}
+
+/* Fixed point version. Samples inside the network are int32 in 1/2^26, so
+   that the delay lines hold up to +-32 like the float ones, coefficients
+   are Q31 and read positions are the same 28 bit phases. Everything that
+   depends on the sample rate or on sp_revsc_params is derived with integer
+   arithmetic too, the output does not depend on libm or on the floating
+   point settings. Results saturate instead of wrapping. */
 
-        /* read four samples for interpolation */
+#define FIX_HEADROOM    5
+#define FIX_Q30         ((int64_t) 1 << 30)
+
+/* output_gain() of 4, 8 and 16 lines in Q31 */
+static const int32_t fixedGain[3] = { 1062950175, 751619277, 531475087 };
+
+static inline int32_t sat_q31(int64_t v)
+{
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : (int32_t) v);
+}
 
-        if (readPos > 0 && readPos < (bufferSize - 2)) {
-            vm1 = (SPFLOAT) (lp->buf[readPos - 1]);
-            v0  = (SPFLOAT) (lp->buf[readPos]);
-            v1  = (SPFLOAT) (lp->buf[readPos + 1]);
-            v2  = (SPFLOAT) (lp->buf[readPos + 2]);
+static inline int32_t fixed_coef(SPFLOAT v)
+{
+    if (v >= 1.0) return INT32_MAX;
+    if (v <= -1.0) return INT32_MIN;
+    return (int32_t) (v * 2147483648.0);
+}
+
+/* sp_revsc_params[n][i] * scale rounded, which is far enough from a tie for any
+   rounding of the product */
+
+static inline int fixed_param(int n, int i, double scale)
+{
+    return (int) (sp_revsc_params[n][i] * scale + 0.5);
+}
+
+static uint64_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0, bit = (uint64_t) 1 << 62;
+
+    while (bit > v) bit >>= 2;
+    while (bit != 0) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
         }
-        else {
-
-        /* at buffer wrap-around, need to check index */
-
-        if (--readPos < 0) readPos += bufferSize;
-            vm1 = (SPFLOAT) lp->buf[readPos];
-        if (++readPos >= bufferSize) readPos -= bufferSize;
-            v0 = (SPFLOAT) lp->buf[readPos];
-        if (++readPos >= bufferSize) readPos -= bufferSize;
-            v1 = (SPFLOAT) lp->buf[readPos];
-        if (++readPos >= bufferSize) readPos -= bufferSize;
-            v2 = (SPFLOAT) lp->buf[readPos];
+        bit >>= 2;
+    }
+    return r;
+}
+
+/* dampFact of block_ctl() in Q31. The cosine is a Taylor series over a
+   quarter turn in Q30, d = 2 - cos and the square root are in Q29. */
+
+static int32_t fixed_damp(SPFLOAT lpfreq, int sr)
+{
+    int64_t freq, turn, x2, c, d;
+    int neg;
+
+    /* Q16 Hz, then the fraction of a turn in Q32 */
+    if (lpfreq <= 0) freq = 0;
+    else if (lpfreq >= sr) freq = (int64_t) sr << 16;
+    else freq = (int64_t) (lpfreq * 65536.0);
+    turn = ((freq << 16) / sr) & 0xFFFFFFFF;
+    if (turn > 0x80000000) turn = 0x100000000 - turn;
+    neg = turn > 0x40000000;
+    if (neg) turn = 0x80000000 - turn;
+
+    /* 2 pi in Q30 */
+    x2 = (turn * 6746518852LL) >> 32;
+    x2 = (x2 * x2) >> 30;
+    c = FIX_Q30 - x2 / 132;
+    c = FIX_Q30 - ((x2 * c) >> 30) / 90;
+    c = FIX_Q30 - ((x2 * c) >> 30) / 56;
+    c = FIX_Q30 - ((x2 * c) >> 30) / 30;
+    c = FIX_Q30 - ((x2 * c) >> 30) / 12;
+    c = FIX_Q30 - ((x2 * c) >> 30) / 2;
+    if (neg) c = -c;
+
+    d = (2 * FIX_Q30 - c) >> 1;
+    d -= (int64_t) isqrt64((uint64_t) (d * d - ((int64_t) 1 << 58)));
+    return sat_q31(d << 2);
+}
+
+/* Delay of line n for a seed, in 1/2^28 samples */
+
+static inline int64_t fixed_delay(sp_revsc_fixed *p, int n, int seed)
+{
+    int64_t depth = p->modDepth[n];
+
+    return p->baseDelay[n] + (depth >> 15) * seed + (((depth & 0x7FFF) * seed) >> 15);
+}
+
+/* sp_revsc_line_samples() with integer arithmetic */
+
+static int fixed_buffer_size(int sr, int n)
+{
+    int64_t base, depth;
+
+    base = ((int64_t) fixed_param(n, 0, DEFAULT_SRATE) * sr << DELAYPOS_SHIFT)
+           / (int64_t) DEFAULT_SRATE;
+    depth = ((int64_t) fixed_param(n, 1, 10000) * sr * 32768 << 13) / 10000;
+    return (int) ((base + depth + depth / 8) >> DELAYPOS_SHIFT) + 17;
+}
+
+/* Same segments as next_random_lineseg(), started at once. The increment is
+   rounded to nearest with a floor division, as C division truncates. */
+
+static void next_fixed_lineseg(sp_revsc_fixed *p, sp_revsc_fixed_dl *lp, int n)
+{
+    int64_t num, den, q;
+    int cnt = p->segLength[n];
+
+    if (p->seedVal[n] < 0)
+      p->seedVal[n] += 0x10000;
+    p->seedVal[n] = (p->seedVal[n] * 15625 + 1) & 0xFFFF;
+    if (p->seedVal[n] >= 0x8000)
+      p->seedVal[n] -= 0x10000;
+
+    num = 2 * (p->delay[n] - fixed_delay(p, n, p->seedVal[n])) + cnt;
+    den = 2 * (int64_t) cnt;
+    q = num >= 0 ? num / den : -((den - 1 - num) / den);
+
+    lp->randLine_cnt[n] = cnt;
+    lp->readPosFrac_inc[n] = (int) (DELAYPOS_SCALE + q);
+    p->delay[n] += (int64_t) cnt * (DELAYPOS_SCALE - lp->readPosFrac_inc[n]);
+}
+
+static void init_fixed_line(sp_revsc_fixed *p, int n)
+{
+    sp_revsc_fixed_dl *lp = &p->delayLines;
+    int64_t sr = p->sampleRate, readPos;
+    int freq = fixed_param(n, 2, 1000);
+    int bytes = p->iStorage == SP_REVSC_Q15 ? 2 : 4;
+
+    /* sp_revsc_params in 1/2^28 samples, seeds scale the variation in Q15 */
+    p->baseDelay[n] = ((int64_t) fixed_param(n, 0, DEFAULT_SRATE) * sr << DELAYPOS_SHIFT)
+                      / (int64_t) DEFAULT_SRATE;
+    p->modDepth[n] = ((int64_t) fixed_param(n, 1, 10000) * sr * p->iPitchMod << 13) / 10000;
+    p->segLength[n] = (int) ((sr * 1000 + freq / 2) / freq);
+
+    lp->bufferSize[n] = fixed_buffer_size(p->sampleRate, n);
+    lp->writePos[n] = 0;
+    p->seedVal[n] = fixed_param(n, 3, 1);
+    p->delay[n] = fixed_delay(p, n, p->seedVal[n]);
+    readPos = (int64_t) lp->bufferSize[n] * DELAYPOS_SCALE - p->delay[n];
+    lp->readPos[n] = (int) (readPos >> DELAYPOS_SHIFT);
+    lp->readPosFrac[n] = (int) (readPos & DELAYPOS_MASK);
+    next_fixed_lineseg(p, lp, n);
+
+    lp->filterState[n] = 0;
+    memset((char *) p->aux.ptr + (lp->bufferOffset[n] - DELAY_GUARD) * bytes,
+           0, bytes * (lp->bufferSize[n] + 2 * DELAY_GUARD));
+}
+
+int sp_revsc_fixed_create(sp_revsc_fixed **p)
+{
+    *p = malloc(sizeof(sp_revsc_fixed));
+    (*p)->interpolation = SP_REVSC_CUBIC;
+    (*p)->iLines = 8;
+    (*p)->iStorage = SP_REVSC_Q31;
+    (*p)->iPitchMod = 32768;
+    (*p)->iMaxSampleRate = 0;
+    (*p)->initDone = 0;
+    return SP_OK;
+}
+
+int sp_revsc_fixed_destroy(sp_revsc_fixed **p)
+{
+    if ((*p)->initDone) sp_auxdata_free(&(*p)->aux);
+    free(*p);
+    return SP_OK;
+}
+
+int sp_revsc_fixed_init(sp_data *sp, sp_revsc_fixed *p)
+{
+    int i, maxRate, nWords = 0;
+
+    p->feedback = 0.97;
+    p->lpfreq = 10000;
+    if (p->iLines != 4 && p->iLines != 16) p->iLines = 8;
+    if (p->iStorage != SP_REVSC_Q15) p->iStorage = SP_REVSC_Q31;
+    if (p->iMaxSampleRate < sp->sr) p->iMaxSampleRate = sp->sr;
+
+    maxRate = (int) (p->iMaxSampleRate + 0.5);
+    for (i = 0; i < p->iLines; i++) {
+        nWords += fixed_buffer_size(maxRate, i) + 2 * DELAY_GUARD;
+    }
+    sp_auxdata_alloc(&p->aux, nWords * (p->iStorage == SP_REVSC_Q15 ? 2 : 4));
+    p->initDone = 1;
+    return sp_revsc_fixed_reset(sp, p);
+}
+
+/* Same as sp_revsc_reset(), lays out and clears the delay lines for sp->sr
+   without allocating. Also applies a new iPitchMod. */
+
+int sp_revsc_fixed_reset(sp_data *sp, sp_revsc_fixed *p)
+{
+    int i, nWords = 0;
+
+    if (p->initDone <= 0 || sp->sr > p->iMaxSampleRate) return SP_NOT_OK;
+    if (p->iPitchMod < 0) p->iPitchMod = 0;
+    if (p->iPitchMod > 32768) p->iPitchMod = 32768;
+    p->sampleRate = (int) (sp->sr + 0.5);
+    p->dampFact = INT32_MAX;
+    p->prv_LPFreq = 0.0;
+    p->prv_Feedback = fixed_coef(p->feedback);
+
+    for (i = 0; i < p->iLines; i++) {
+        p->delayLines.bufferOffset[i] = nWords + DELAY_GUARD;
+        init_fixed_line(p, i);
+        nWords += fixed_buffer_size(p->sampleRate, i) + 2 * DELAY_GUARD;
+    }
+    return SP_OK;
+}
+
+static inline __attribute__((always_inline))
+int32_t load_fixed(const void *mem, int i, const int storage)
+{
+    if (storage == SP_REVSC_Q15) return ((const int16_t *) mem)[i] * 65536;
+    return ((const int32_t *) mem)[i];
+}
+
+static inline __attribute__((always_inline))
+void store_fixed(void *mem, int i, int32_t v, const int storage)
+{
+    int64_t w;
+
+    if (storage == SP_REVSC_Q15) {
+        w = ((int64_t) v + 0x8000) >> 16;
+        ((int16_t *) mem)[i] = w > 32767 ? 32767 : (w < -32767 ? -32767 : (int16_t) w);
+    } else {
+        ((int32_t *) mem)[i] = v;
+    }
+}
+
+/* compute_block_scalar() in fixed point, inlined for each storage format
+   and interpolation */
+
+static inline __attribute__((always_inline))
+void compute_block_fixed(sp_revsc_fixed *p, const int32_t *in1, const int32_t *in2,
+                         int32_t *out1, int32_t *out2, uint32_t nframes,
+                         int64_t dampFact, int64_t dampStep,
+                         int64_t feedback, int64_t feedbackStep,
+                         const int storage, const int interpolation)
+{
+    const int lines = p->iLines;
+    const int shift = lines == 4 ? 1 : (lines == 16 ? 3 : 2);
+    const int64_t gain = fixedGain[lines / 8];
+    void *mem = p->aux.ptr;
+    int64_t junction, aoutL, aoutR, frac, f2, am1, a0, a1, a2, acc;
+    int32_t ainL, ainR, v0;
+    int readPos, writePos, bufferSize, offset, n;
+    uint32_t i;
+
+    /* local copy of the delay line state */
+
+    sp_revsc_fixed_dl dl = p->delayLines;
+
+    for (i = 0; i < nframes; i++) {
+        dampFact += dampStep;
+        feedback += feedbackStep;
+
+        /* junction pressure, the sum of the lines scaled by 2 / N */
+
+        junction = 0;
+        for (n = 0; n < lines; n++) {
+            junction += dl.filterState[n];
         }
-        v0 = (am1 * vm1 + a0 * v0 + a1 * v1 + a2 * v2) * frac + v0;
+        junction >>= shift;
+        ainL = sat_q31(junction + (in1[i] >> FIX_HEADROOM));
+        ainR = sat_q31(junction + (in2[i] >> FIX_HEADROOM));
+        aoutL = aoutR = 0;
 
-        /* update buffer read position */
+        for (n = 0; n < lines; n++) {
+            offset = dl.bufferOffset[n];
+            bufferSize = dl.bufferSize[n];
 
-        lp->readPosFrac += lp->readPosFrac_inc;
+            v0 = sat_q31((int64_t) (n & 1 ? ainR : ainL) - dl.filterState[n]);
+            writePos = dl.writePos[n];
+            store_fixed(mem, offset + writePos, v0, storage);
+            writePos += (bufferSize & -(writePos < DELAY_GUARD))
+                        - (bufferSize & -(writePos >= bufferSize - DELAY_GUARD));
+            store_fixed(mem, offset + writePos, v0, storage);
+            writePos = dl.writePos[n] + 1;
+            dl.writePos[n] = writePos - (bufferSize & -(writePos >= bufferSize));
 
-        /* apply feedback gain and lowpass filter */
+            readPos = dl.readPos[n] + (dl.readPosFrac[n] >> DELAYPOS_SHIFT);
+            dl.readPosFrac[n] &= DELAYPOS_MASK;
+            readPos -= bufferSize & -(readPos >= bufferSize);
+            dl.readPos[n] = readPos;
+            readPos += offset;
+            frac = dl.readPosFrac[n];
 
-        v0 *= (SPFLOAT) p->feedback;
-        v0 = (lp->filterState - v0) * dampFact + v0;
-        lp->filterState = v0;
+            /* cubic Lagrange coefficients in Q28, same arrangement as
+               compute_block_scalar(), taps accumulate in 64 bits */
 
-        /* mix to output */
+            if (interpolation == SP_REVSC_CUBIC) {
+                f2 = (frac * frac) >> DELAYPOS_SHIFT;
+                a2 = ((f2 - DELAYPOS_SCALE) * 715827883) >> 32;
+                a1 = (frac + DELAYPOS_SCALE) >> 1;
+                am1 = a1 - DELAYPOS_SCALE;
+                a0 = 3 * a2;
+                a1 -= a0;
+                am1 -= a2;
+                a0 -= frac;
+                acc = am1 * load_fixed(mem, readPos - 1, storage)
+                      + a0 * load_fixed(mem, readPos, storage)
+                      + a1 * load_fixed(mem, readPos + 1, storage)
+                      + a2 * load_fixed(mem, readPos + 2, storage);
+                acc >>= DELAYPOS_SHIFT;
+                v0 = sat_q31(((acc * frac) >> DELAYPOS_SHIFT)
+                             + load_fixed(mem, readPos, storage));
+            } else if (interpolation == SP_REVSC_LINEAR) {
+                v0 = load_fixed(mem, readPos, storage);
+                acc = (int64_t) load_fixed(mem, readPos + 1, storage) - v0;
+                v0 = sat_q31(((acc * frac) >> DELAYPOS_SHIFT) + v0);
+            } else {
+                v0 = load_fixed(mem, readPos, storage);
+            }
 
-        if (n & 1) {
-            aoutR += v0;
-        }else{
-            aoutL += v0;
+            dl.readPosFrac[n] += dl.readPosFrac_inc[n];
+
+            /* feedback gain and lowpass filter, the products fit in 63 bits */
+
+            v0 = (int32_t) (((int64_t) v0 * feedback) >> 31);
+            v0 = sat_q31(((((int64_t) dl.filterState[n] - v0) * dampFact) >> 31) + v0);
+            dl.filterState[n] = v0;
+
+            if (n & 1) {
+                aoutR += v0;
+            } else {
+                aoutL += v0;
+            }
+
+            if (--dl.randLine_cnt[n] <= 0) {
+                next_fixed_lineseg(p, &dl, n);
+            }
         }
 
-        /* start next random line segment if current one has reached endpoint */
+        out1[i] = sat_q31((sat_q31(aoutL) * gain) >> (31 - FIX_HEADROOM));
+        out2[i] = sat_q31((sat_q31(aoutR) * gain) >> (31 - FIX_HEADROOM));
+    }
+
+    /* save the delay line state */
+
+    p->delayLines = dl;
+}
+
+int sp_revsc_fixed_compute_block(sp_data *sp, sp_revsc_fixed *p, int32_t *in1, int32_t *in2,
+                                 int32_t *out1, int32_t *out2, uint32_t nframes)
+{
+    int64_t dampFact = p->dampFact, dampStep, feedbackStep;
+    int32_t feedback = fixed_coef(p->feedback);
+
+    if (p->initDone <= 0) return SP_NOT_OK;
+    if (nframes == 0) return SP_OK;
+
+    /* same control as block_ctl(), in Q31 */
 
-        if (--(lp->randLine_cnt) <= 0) {
-            next_random_lineseg(p, lp, n);
+    if (p->lpfreq != p->prv_LPFreq) {
+        dampFact = fixed_damp(p->lpfreq, p->sampleRate);
+        if (p->prv_LPFreq == 0.0) {
+            p->dampFact = (int32_t) dampFact;
+            p->prv_Feedback = feedback;
         }
+        p->prv_LPFreq = p->lpfreq;
     }
-    /* someday, use aoutR for multimono out */
+    dampStep = (dampFact - p->dampFact) / (int64_t) nframes;
+    feedbackStep = ((int64_t) feedback - p->prv_Feedback) / (int64_t) nframes;
 
-    *out1  = aoutL * outputGain;
-    *out2 = aoutR * outputGain;
+#define FIXED_VARIANT(storage, interpolation) \
+    compute_block_fixed(p, in1, in2, out1, out2, nframes, p->dampFact, dampStep, \
+                        p->prv_Feedback, feedbackStep, storage, interpolation)
+
+    if (p->iStorage == SP_REVSC_Q15) {
+        if (p->interpolation == SP_REVSC_CUBIC) FIXED_VARIANT(SP_REVSC_Q15, SP_REVSC_CUBIC);
+        else if (p->interpolation == SP_REVSC_LINEAR) FIXED_VARIANT(SP_REVSC_Q15, SP_REVSC_LINEAR);
+        else FIXED_VARIANT(SP_REVSC_Q15, SP_REVSC_NONE);
+    } else {
+        if (p->interpolation == SP_REVSC_CUBIC) FIXED_VARIANT(SP_REVSC_Q31, SP_REVSC_CUBIC);
+        else if (p->interpolation == SP_REVSC_LINEAR) FIXED_VARIANT(SP_REVSC_Q31, SP_REVSC_LINEAR);
+        else FIXED_VARIANT(SP_REVSC_Q31, SP_REVSC_NONE);
+    }
+
+#undef FIXED_VARIANT
+
+    p->dampFact = (int32_t) dampFact;
+    p->prv_Feedback = feedback;
     return SP_OK;
 }
+
+int sp_revsc_fixed_compute(sp_data *sp, sp_revsc_fixed *p, int32_t *in1, int32_t *in2,
+                           int32_t *out1, int32_t *out2)
+{
+    return sp_revsc_fixed_compute_block(sp, p, in1, in2, out1, out2, 1);
+}
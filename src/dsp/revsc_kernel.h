@@ -0,0 +1,244 @@
+/*
+ * RevSC kernels for one instruction set
+ *
+ * Included by revsc.c once per instruction set, with the target of the
+ * functions set and these defined:
+ *
+ *   REVSC_ISA          name of the set, appended to everything defined here
+ *   REVSC_ISA_GATHER   1 to load taps with AVX2 gathers
+ *   REVSC_ISA_SCATTER  1 to store to the delay lines with AVX-512 scatters
+ *   REVSC_ISA_F16C     1 to convert half floats with F16C
+ *
+ */
+
+#define REVSC_LANES 8
+#include "revsc_lanes.h"
+#define REVSC_LANES 4
+#include "revsc_lanes.h"
+#define REVSC_LANES 16
+#include "revsc_lanes.h"
+
+#if REVSC_ISA_GATHER
+
+/* Runs the 8 bank members from first on, one per lane. The vectors hold the
+   same line of all lanes, so the junction and outputs are vertical sums. */
+
+static inline __attribute__((always_inline))
+void REVSC_KERNEL(compute_bank_simd)(sp_revsc_bank *b, const int first,
+                                     SPFLOAT **in1, SPFLOAT **in2,
+                                     SPFLOAT **out1, SPFLOAT **out2,
+                                     uint32_t start, uint32_t nframes,
+                                     const revsc_bank_ctl *ctl, const int storage,
+                                     const int pow2, const int interpolation)
+{
+    revsc_vf_8 dampFact = ctl->dampFact;
+    revsc_vf_8 feedback = ctl->feedback;
+    revsc_vf_8 dn, junction, ainL, ainR, aoutL, aoutR, ain;
+    revsc_vf_8 frac, vm1, v0, v1, v2, am1, a0, a1, a2;
+    revsc_vf_8 filterState[8];
+    revsc_vi_8 bufferSize[8], bufferOffset[8], writePos[8], readPos[8];
+    revsc_vi_8 readPosFrac[8], readPosFrac_inc[8], idx, mirror;
+    int randLine_cnt[8][8];
+    int segStep, segLeft, n, l;
+    void *mem = b->aux.ptr;
+    const int prefetch = b->prefetch;
+    uint32_t i, run, end;
+
+    /* transpose the member state, line n of all lanes goes to vectors [n] */
+
+    for (l = 0; l < 8; l++) {
+        sp_revsc *p = b->revsc[first + l];
+        sp_revsc_dl *lp = &p->delayLines;
+        int memOffset = (int) ((char *) p->aux.ptr - (char *) mem) / sample_bytes(storage);
+
+        dn[l] = p->antiDenormal;
+        for (n = 0; n < 8; n++) {
+            bufferSize[n][l] = lp->bufferSize[n];
+            bufferOffset[n][l] = memOffset + lp->bufferOffset[n];
+            writePos[n][l] = lp->writePos[n];
+            readPos[n][l] = lp->readPos[n];
+            readPosFrac[n][l] = lp->readPosFrac[n];
+            readPosFrac_inc[n][l] = lp->readPosFrac_inc[n];
+            filterState[n][l] = lp->filterState[n];
+            randLine_cnt[n][l] = lp->randLine_cnt[n];
+        }
+    }
+
+    /* samples until the next random line segment of any member starts */
+
+    segStep = randLine_cnt[0][0];
+    for (n = 0; n < 8; n++) {
+        for (l = 0; l < 8; l++) {
+            if (randLine_cnt[n][l] < segStep) segStep = randLine_cnt[n][l];
+        }
+    }
+    segLeft = segStep;
+
+    aoutL = (filterState[0] + filterState[2]) + (filterState[4] + filterState[6]);
+    aoutR = (filterState[1] + filterState[3]) + (filterState[5] + filterState[7]);
+
+    for (i = start; i < start + nframes; ) {
+        run = start + nframes - i < (uint32_t) segLeft ? start + nframes - i
+                                                       : (uint32_t) segLeft;
+        for (end = i + run; i < end; i++) {
+            dampFact += ctl->dampStep;
+            feedback += ctl->feedbackStep;
+
+            /* calculate "resultant junction pressure" and mix to input signals */
+
+            junction = (aoutL + aoutR) * junction_scale(8) + dn;
+            dn = -dn;
+            ainL = ainR = junction;
+            for (l = 0; l < 8; l++) {
+                ainL[l] += in1[first + l][i];
+                ainR[l] += in2[first + l][i];
+            }
+
+            for (n = 0; n < 8; n++) {
+
+                /* send input signal and feedback to delay line, samples near
+                   either end are also written to the guard at the other end */
+
+                ain = (n & 1 ? ainR : ainL) - filterState[n];
+                idx = bufferOffset[n] + writePos[n];
+                mirror = idx + (bufferSize[n] & (writePos[n] < DELAY_GUARD))
+                             - (bufferSize[n] & (writePos[n] >= bufferSize[n] - DELAY_GUARD));
+                REVSC_KERNEL(scatter_taps_8)(mem, &idx, &mirror, &ain, storage);
+                writePos[n] += 1;
+                REVSC_KERNEL(wrap_pos_8)(&writePos[n], &bufferSize[n], pow2);
+
+                /* read from delay line with cubic, linear or no interpolation */
+
+                readPos[n] += readPosFrac[n] >> DELAYPOS_SHIFT;
+                readPosFrac[n] &= DELAYPOS_MASK;
+                REVSC_KERNEL(wrap_pos_8)(&readPos[n], &bufferSize[n], pow2);
+
+                idx = bufferOffset[n] + readPos[n];
+
+                /* fetch ahead of one line of all lanes per frame, as in
+                   compute_block_simd() */
+
+                if (prefetch && n == (int) (i & 7)) {
+                    for (l = 0; l < 8; l++) {
+                        __builtin_prefetch((char *) mem
+                                           + (idx[l] + prefetch) * sample_bytes(storage));
+                    }
+                }
+
+                REVSC_KERNEL(gather_taps_8)(&v0, mem, &idx, storage);
+                frac = __builtin_convertvector(readPosFrac[n], revsc_vf_8)
+                       * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+
+                if (interpolation == SP_REVSC_CUBIC) {
+                    idx -= 1;
+                    REVSC_KERNEL(gather_taps_8)(&vm1, mem, &idx, storage);
+                    idx += 2;
+                    REVSC_KERNEL(gather_taps_8)(&v1, mem, &idx, storage);
+                    idx += 1;
+                    REVSC_KERNEL(gather_taps_8)(&v2, mem, &idx, storage);
+
+                    a2 = frac * frac; a2 -= 1; a2 *= (SPFLOAT) (1.0 / 6.0);
+                    a1 = frac; a1 += 1; a1 *= (SPFLOAT) 0.5; am1 = a1 - 1;
+                    a0 = 3 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
+
+                    v0 = (am1 * vm1 + a0 * v0 + a1 * v1 + a2 * v2) * frac + v0;
+                } else if (interpolation == SP_REVSC_LINEAR) {
+                    idx += 1;
+                    REVSC_KERNEL(gather_taps_8)(&v1, mem, &idx, storage);
+                    v0 += (v1 - v0) * frac;
+                }
+
+                /* update buffer read position */
+
+                readPosFrac[n] += readPosFrac_inc[n];
+
+                /* apply feedback gain and lowpass filter */
+
+                v0 *= feedback;
+                v0 = (filterState[n] - v0) * dampFact + v0;
+                filterState[n] = v0;
+            }
+
+            /* mix to output, summed in the same order as in compute_block_simd() */
+
+            aoutL = (filterState[0] + filterState[2]) + (filterState[4] + filterState[6]);
+            aoutR = (filterState[1] + filterState[3]) + (filterState[5] + filterState[7]);
+            for (l = 0; l < 8; l++) {
+                out1[first + l][i] = aoutL[l] * output_gain(8);
+                out2[first + l][i] = aoutR[l] * output_gain(8);
+            }
+        }
+
+        /* start next random line segments of members that reached their
+           endpoint */
+
+        segLeft -= run;
+        if (segLeft == 0) {
+            for (l = 0; l < 8; l++) {
+                sp_revsc *p = b->revsc[first + l];
+                for (n = 0; n < 8; n++) {
+                    randLine_cnt[n][l] -= segStep;
+                    if (randLine_cnt[n][l] <= 0) {
+                        pop_random_lineseg(p, &p->delayLines, n);
+                        readPosFrac_inc[n][l] = p->delayLines.readPosFrac_inc[n];
+                        randLine_cnt[n][l] = p->delayLines.randLine_cnt[n];
+                    }
+                }
+            }
+            segStep = randLine_cnt[0][0];
+            for (n = 0; n < 8; n++) {
+                for (l = 0; l < 8; l++) {
+                    if (randLine_cnt[n][l] < segStep) segStep = randLine_cnt[n][l];
+                }
+            }
+            segLeft = segStep;
+        }
+    }
+
+    for (l = 0; l < 8; l++) {
+        sp_revsc *p = b->revsc[first + l];
+        sp_revsc_dl *lp = &p->delayLines;
+
+        p->antiDenormal = dn[l];
+        for (n = 0; n < 8; n++) {
+            lp->writePos[n] = writePos[n][l];
+            lp->readPos[n] = readPos[n][l];
+            lp->readPosFrac[n] = readPosFrac[n][l];
+            lp->readPosFrac_inc[n] = readPosFrac_inc[n][l];
+            lp->filterState[n] = filterState[n][l];
+            lp->randLine_cnt[n] = randLine_cnt[n][l] - (segStep - segLeft);
+        }
+    }
+}
+
+#endif /* REVSC_ISA_GATHER */
+
+#if REVSC_ISA_GATHER
+BANK_STORAGE_VARIANTS(float, SP_REVSC_FLOAT)
+BANK_STORAGE_VARIANTS(half,  SP_REVSC_HALF)
+BANK_STORAGE_VARIANTS(int16, SP_REVSC_INT16)
+#endif
+
+static const revsc_kernels REVSC_KERNEL(kernels) = {
+    REVSC_STR(REVSC_ISA),
+    {
+        SIMD_RATE_ROW(0), SIMD_RATE_ROW(1), SIMD_RATE_ROW(2),
+        SIMD_RATE_ROW(3), SIMD_RATE_ROW(4), SIMD_RATE_ROW(5)
+    },
+    { SIMD_STORAGE_ROW(half, 8), SIMD_STORAGE_ROW(int16, 8) },
+    {
+        { SIMD_STORAGE_ROW(float, 4), SIMD_STORAGE_ROW(half, 4), SIMD_STORAGE_ROW(int16, 4) },
+        { SIMD_STORAGE_ROW(float, 16), SIMD_STORAGE_ROW(half, 16), SIMD_STORAGE_ROW(int16, 16) }
+    },
+    { TB_LINES_ROW(4), TB_LINES_ROW(8), TB_LINES_ROW(16) },
+#if REVSC_ISA_GATHER
+    { BANK_STORAGE_ROW(float), BANK_STORAGE_ROW(half), BANK_STORAGE_ROW(int16) }
+#else
+    { { { NULL } } }
+#endif
+};
+
+#undef REVSC_ISA
+#undef REVSC_ISA_GATHER
+#undef REVSC_ISA_SCATTER
+#undef REVSC_ISA_F16C
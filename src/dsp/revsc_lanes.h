@@ -0,0 +1,795 @@
+/*
+ * RevSC kernels for one network size
+ *
+ * Included by revsc_kernel.h once per number of delay lines, with
+ * REVSC_LANES defined as 4, 8 or 16. Each line is one lane, so for float
+ * the vectors are one SSE/NEON, AVX or AVX-512 register. Narrower
+ * instruction sets split wider vectors into several registers.
+ *
+ */
+
+#define lane_vf   REVSC_PASTE(revsc_vf, REVSC_LANES)
+#define lane_vi   REVSC_PASTE(revsc_vi, REVSC_LANES)
+#define lane_vf32 REVSC_PASTE(revsc_vf32, REVSC_LANES)
+
+/* wrap a position that is at most one buffer length past the end */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(wrap_pos)(lane_vi *pos, const lane_vi *bufferSize, const int pow2)
+{
+    if (pow2) {
+        *pos &= *bufferSize - 1;
+    } else {
+        *pos -= *bufferSize & (*pos >= *bufferSize);
+    }
+}
+
+/* Sum of the even (first = 0) or odd (first = 1) lanes as a balanced tree,
+   for 8 lines (v[0] + v[2]) + (v[4] + v[6]) */
+
+static inline __attribute__((always_inline))
+SPFLOAT REVSC_LANE(sum_lanes)(const lane_vf *v, const int first)
+{
+    SPFLOAT sum[REVSC_LANES / 2];
+    int n, k;
+
+    for (n = 0; n < REVSC_LANES / 2; n++) {
+        sum[n] = (*v)[2 * n + first];
+    }
+    for (k = REVSC_LANES / 4; k > 0; k /= 2) {
+        for (n = 0; n < k; n++) {
+            sum[n] = sum[2 * n] + sum[2 * n + 1];
+        }
+    }
+    return sum[0];
+}
+
+/* Convert between SPFLOAT and 16 bit delay line samples, one per lane in the
+   low bits of an int32, with integer operations that any vector unit has.
+   Half floats are rounded to nearest, ties away from zero for normals (F16C
+   kernels round ties to even), and clamped to 65504. 16 bit integers are
+   rounded to nearest even and clamped. Adding 1.5 * 2^23 leaves a float
+   rounded to an integer in the low bits, which needs the integer to be below
+   2^22. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(encode_taps)(lane_vi *w, const lane_vf *v, const int storage)
+{
+    lane_vf32 f = __builtin_convertvector(*v, lane_vf32);
+    lane_vi mag, normal, subnormal;
+
+    if (storage == SP_REVSC_INT16) {
+        f = f * (float) INT16_SCALE + 12582912.0f;
+        *w = (lane_vi) f - 0x4B400000;
+        *w -= (*w - 32767) & (*w > 32767);
+        *w -= (*w + 32767) & (*w < -32767);
+    } else {
+        /* rebias the exponent from 127 to 15, below 2^-14 count in 2^-24 */
+        mag = (lane_vi) f & 0x7FFFFFFF;
+        normal = (mag - (112 << 23) + 0x1000) >> 13;
+        normal -= (normal - 0x7BFF) & (normal > 0x7BFF);
+        subnormal = (lane_vi) ((lane_vf32) mag * 16777216.0f + 12582912.0f) - 0x4B400000;
+        *w = (normal & (mag >= (113 << 23))) | (subnormal & (mag < (113 << 23)));
+        *w |= ((lane_vi) f >> 16) & 0x8000;
+    }
+}
+
+/* w holds zero extended half floats or sign extended integers */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(decode_taps)(lane_vf *v, const lane_vi *w, const int storage)
+{
+    lane_vi mag, normal, subnormal;
+
+    if (storage == SP_REVSC_INT16) {
+        *v = __builtin_convertvector(*w, lane_vf) * (SPFLOAT) (1.0 / INT16_SCALE);
+    } else {
+        mag = *w & 0x7FFF;
+        normal = (mag << 13) + (112 << 23);
+        subnormal = (lane_vi) (__builtin_convertvector(mag, lane_vf32) * (1.0f / 16777216.0f));
+        mag = (normal & (mag >= 0x400)) | (subnormal & (mag < 0x400));
+        *v = __builtin_convertvector((lane_vf32) (mag | ((*w & 0x8000) << 16)), lane_vf);
+    }
+}
+
+#if REVSC_ISA_GATHER
+
+/* Hardware gathers of the 32 bit words at byte offsets idx * 4 (gather_ps)
+   or idx * 2 (gather_epi16) from mem. Without AVX-512, 16 lanes take two
+   AVX2 gathers of the 8 lane versions. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(gather_ps)(lane_vf32 *v, const void *mem, const lane_vi *idx)
+{
+#if REVSC_LANES == 4
+    *v = (lane_vf32) _mm_i32gather_ps(mem, (__m128i) *idx, 4);
+#elif REVSC_LANES == 8
+    *v = (lane_vf32) _mm256_i32gather_ps(mem, (__m256i) *idx, 4);
+#elif REVSC_ISA_SCATTER
+    *v = (lane_vf32) _mm512_i32gather_ps((__m512i) *idx, mem, 4);
+#else
+    revsc_vi_8 half[2];
+    revsc_vf32_8 f[2];
+    memcpy(half, idx, sizeof(half));
+    REVSC_KERNEL(gather_ps_8)(&f[0], mem, &half[0]);
+    REVSC_KERNEL(gather_ps_8)(&f[1], mem, &half[1]);
+    memcpy(v, f, sizeof(f));
+#endif
+}
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(gather_epi16)(lane_vi *w, const void *mem, const lane_vi *idx)
+{
+#if REVSC_LANES == 4
+    *w = (lane_vi) _mm_i32gather_epi32(mem, (__m128i) *idx, 2);
+#elif REVSC_LANES == 8
+    *w = (lane_vi) _mm256_i32gather_epi32(mem, (__m256i) *idx, 2);
+#elif REVSC_ISA_SCATTER
+    *w = (lane_vi) _mm512_i32gather_epi32((__m512i) *idx, mem, 2);
+#else
+    revsc_vi_8 half[2];
+    memcpy(half, idx, sizeof(half));
+    REVSC_KERNEL(gather_epi16_8)(&half[0], mem, &half[0]);
+    REVSC_KERNEL(gather_epi16_8)(&half[1], mem, &half[1]);
+    memcpy(w, half, sizeof(half));
+#endif
+}
+
+#endif /* REVSC_ISA_GATHER */
+
+#if REVSC_ISA_F16C
+
+/* F16C conversions, h holds zero extended half floats */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(cvtph_ps)(lane_vf32 *f, const lane_vi *h)
+{
+#if REVSC_LANES == 4
+    *f = (lane_vf32) _mm_cvtph_ps(_mm_packus_epi32((__m128i) *h, _mm_setzero_si128()));
+#elif REVSC_LANES == 8
+    __m256i w = (__m256i) *h;
+    *f = (lane_vf32) _mm256_cvtph_ps(_mm_packus_epi32(_mm256_castsi256_si128(w),
+                                                      _mm256_extracti128_si256(w, 1)));
+#elif REVSC_ISA_SCATTER
+    *f = (lane_vf32) _mm512_cvtph_ps(_mm512_cvtepi32_epi16((__m512i) *h));
+#else
+    revsc_vi_8 half[2];
+    revsc_vf32_8 v[2];
+    memcpy(half, h, sizeof(half));
+    REVSC_KERNEL(cvtph_ps_8)(&v[0], &half[0]);
+    REVSC_KERNEL(cvtph_ps_8)(&v[1], &half[1]);
+    memcpy(f, v, sizeof(v));
+#endif
+}
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(cvtps_ph)(uint16_t *h, const lane_vf32 *f)
+{
+#if REVSC_LANES == 4
+    _mm_storel_epi64((__m128i *) h, _mm_cvtps_ph((__m128) *f, _MM_FROUND_TO_NEAREST_INT));
+#elif REVSC_LANES == 8
+    _mm_storeu_si128((__m128i *) h, _mm256_cvtps_ph((__m256) *f, _MM_FROUND_TO_NEAREST_INT));
+#elif REVSC_ISA_SCATTER
+    _mm256_storeu_si256((__m256i *) h, _mm512_cvtps_ph((__m512) *f, _MM_FROUND_TO_NEAREST_INT));
+#else
+    revsc_vf32_8 v[2];
+    memcpy(v, f, sizeof(v));
+    REVSC_KERNEL(cvtps_ph_8)(h, &v[0]);
+    REVSC_KERNEL(cvtps_ph_8)(h + 8, &v[1]);
+#endif
+}
+
+#endif /* REVSC_ISA_F16C */
+
+/* load one sample per lane, idx is relative to the start of the delay memory */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(gather_taps)(lane_vf *v, const void *mem, const lane_vi *idx,
+                             const int storage)
+{
+    if (storage == SP_REVSC_FLOAT) {
+#if REVSC_ISA_GATHER && !defined(USE_DOUBLE)
+        REVSC_LANE(gather_ps)(v, mem, idx);
+#else
+        SPFLOAT taps[REVSC_LANES];
+        int n;
+        for (n = 0; n < REVSC_LANES; n++) {
+            taps[n] = ((const SPFLOAT *) mem)[(*idx)[n]];
+        }
+        memcpy(v, taps, sizeof(taps));
+#endif
+    } else {
+        lane_vi w;
+#if REVSC_ISA_GATHER
+        /* the sample is the low half of a 32 bit load */
+        REVSC_LANE(gather_epi16)(&w, mem, idx);
+#if REVSC_ISA_F16C
+        if (storage == SP_REVSC_HALF) {
+            lane_vf32 f;
+            w &= 0xFFFF;
+            REVSC_LANE(cvtph_ps)(&f, &w);
+            *v = __builtin_convertvector(f, lane_vf);
+            return;
+        }
+#endif
+        w = storage == SP_REVSC_INT16 ? (w << 16) >> 16 : w & 0xFFFF;
+#else
+        int32_t taps[REVSC_LANES];
+        int n;
+        for (n = 0; n < REVSC_LANES; n++) {
+            taps[n] = storage == SP_REVSC_INT16 ? ((const int16_t *) mem)[(*idx)[n]]
+                                                : ((const uint16_t *) mem)[(*idx)[n]];
+        }
+        memcpy(&w, taps, sizeof(taps));
+#endif
+        REVSC_LANE(decode_taps)(v, &w, storage);
+    }
+}
+
+/* store one sample per lane at idx and at mirror, lanes never share an index
+   unless their values are the same */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(scatter_taps)(void *mem, const lane_vi *idx, const lane_vi *mirror,
+                              const lane_vf *v, const int storage)
+{
+    int n;
+
+    if (storage == SP_REVSC_FLOAT) {
+#if REVSC_ISA_SCATTER && !defined(USE_DOUBLE) && REVSC_LANES == 4
+        _mm_i32scatter_ps(mem, (__m128i) *idx, (__m128) *v, sizeof(float));
+        _mm_i32scatter_ps(mem, (__m128i) *mirror, (__m128) *v, sizeof(float));
+#elif REVSC_ISA_SCATTER && !defined(USE_DOUBLE) && REVSC_LANES == 8
+        _mm256_i32scatter_ps(mem, (__m256i) *idx, (__m256) *v, sizeof(float));
+        _mm256_i32scatter_ps(mem, (__m256i) *mirror, (__m256) *v, sizeof(float));
+#elif REVSC_ISA_SCATTER && !defined(USE_DOUBLE)
+        _mm512_i32scatter_ps(mem, (__m512i) *idx, (__m512) *v, sizeof(float));
+        _mm512_i32scatter_ps(mem, (__m512i) *mirror, (__m512) *v, sizeof(float));
+#else
+        for (n = 0; n < REVSC_LANES; n++) {
+            ((SPFLOAT *) mem)[(*idx)[n]] = (*v)[n];
+            ((SPFLOAT *) mem)[(*mirror)[n]] = (*v)[n];
+        }
+#endif
+    } else {
+        lane_vi w;
+#if REVSC_ISA_F16C
+        if (storage == SP_REVSC_HALF) {
+            uint16_t h[REVSC_LANES];
+            lane_vf32 f = __builtin_convertvector(*v, lane_vf32);
+            REVSC_LANE(cvtps_ph)(h, &f);
+            for (n = 0; n < REVSC_LANES; n++) {
+                ((uint16_t *) mem)[(*idx)[n]] = h[n];
+                ((uint16_t *) mem)[(*mirror)[n]] = h[n];
+            }
+            return;
+        }
+#endif
+        REVSC_LANE(encode_taps)(&w, v, storage);
+        for (n = 0; n < REVSC_LANES; n++) {
+            ((uint16_t *) mem)[(*idx)[n]] = (uint16_t) w[n];
+            ((uint16_t *) mem)[(*mirror)[n]] = (uint16_t) w[n];
+        }
+    }
+}
+
+/* Vectorized implementation, one lane per delay line so that the whole network
+   advances in lockstep. Compared to the scalar path the junction pressure and
+   the L/R sums are reduced in a different order, which keeps the output within
+   1e-6 of compute_block_scalar(), above 125 dB SNR over the decay of a white
+   noise burst, with any interpolation. tests/revsc_simd.c checks this. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(compute_block_simd)(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+                                    SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes,
+                                    const revsc_ctl *ctl, const int rate, const int storage,
+                                    const int pow2, const int interpolation)
+{
+    SPFLOAT dampFact = ctl->dampFact;
+    SPFLOAT feedback = ctl->feedback;
+    const SPFLOAT jpScale = junction_scale(REVSC_LANES);
+    const SPFLOAT gain = output_gain(REVSC_LANES);
+    lane_vf evenLanes, oddLanes;
+    SPFLOAT ainL, ainR, aoutL, aoutR;
+    SPFLOAT dn = p->antiDenormal;
+    lane_vf ain, frac, vm1, v0, v1, v2, am1, a0, a1, a2;
+    lane_vi idx, mirror, bufferSize, bufferOffset, writePos, readPos, readPosFrac, readPosFrac_inc;
+    lane_vf filterState;
+    int randLine_cnt[REVSC_LANES];
+    int segStep, segLeft;
+    uint32_t run, end;
+    void *mem = p->aux.ptr;
+    sp_revsc_dl *lp = &p->delayLines;
+    const int prefetch = p->prefetch;
+    uint32_t i;
+    int n;
+
+    /* even lines feed the left channel, odd lines the right one */
+
+    for (n = 0; n < REVSC_LANES; n++) {
+        evenLanes[n] = (n & 1) ? 0 : 1;
+        oddLanes[n] = (n & 1) ? 1 : 0;
+    }
+
+    /* the layout is constant in kernels specialized for a rate */
+
+#if REVSC_LANES == 8
+    if (rate) {
+        for (n = 0; n < REVSC_LANES; n++) {
+            bufferSize[n] = variant_buffer_size(rate, pow2, n);
+            bufferOffset[n] = variant_buffer_offset(rate, pow2, n);
+        }
+    } else
+#endif
+    {
+        memcpy(&bufferSize, lp->bufferSize, sizeof(bufferSize));
+        memcpy(&bufferOffset, lp->bufferOffset, sizeof(bufferOffset));
+    }
+    memcpy(&writePos, lp->writePos, sizeof(writePos));
+    memcpy(&readPos, lp->readPos, sizeof(readPos));
+    memcpy(&readPosFrac, lp->readPosFrac, sizeof(readPosFrac));
+    memcpy(&readPosFrac_inc, lp->readPosFrac_inc, sizeof(readPosFrac_inc));
+    memcpy(&filterState, lp->filterState, sizeof(filterState));
+    memcpy(randLine_cnt, lp->randLine_cnt, sizeof(randLine_cnt));
+
+    /* samples until the next random line segment of any line starts */
+
+    segStep = randLine_cnt[0];
+    for (n = 1; n < REVSC_LANES; n++) {
+        if (randLine_cnt[n] < segStep) segStep = randLine_cnt[n];
+    }
+    segLeft = segStep;
+
+    aoutL = REVSC_LANE(sum_lanes)(&filterState, 0);
+    aoutR = REVSC_LANE(sum_lanes)(&filterState, 1);
+
+    /* run sample by sample up to the next segment start of any line */
+
+    for (i = 0; i < nframes; ) {
+        run = nframes - i < (uint32_t) segLeft ? nframes - i : (uint32_t) segLeft;
+        for (end = i + run; i < end; i++) {
+            dampFact += ctl->dampStep;
+            feedback += ctl->feedbackStep;
+
+            /* calculate "resultant junction pressure" and mix to input signals,
+               the sum of all filter states is what was sent to the outputs */
+
+            ainL = (aoutL + aoutR) * jpScale + dn;
+            dn = -dn;
+            ainR = ainL + in2[i];
+            ainL = ainL + in1[i];
+            ain = evenLanes * ainL + oddLanes * ainR;
+
+            /* send input signal and feedback to delay lines, samples near
+               either end are also written to the guard at the other end */
+
+            ain -= filterState;
+            idx = bufferOffset + writePos;
+            mirror = idx + (bufferSize & (writePos < DELAY_GUARD))
+                         - (bufferSize & (writePos >= bufferSize - DELAY_GUARD));
+            REVSC_LANE(scatter_taps)(mem, &idx, &mirror, &ain, storage);
+            writePos += 1;
+            REVSC_LANE(wrap_pos)(&writePos, &bufferSize, pow2);
+
+            /* read from delay lines with cubic, linear or no interpolation */
+
+            readPos += readPosFrac >> DELAYPOS_SHIFT;
+            readPosFrac &= DELAYPOS_MASK;
+            REVSC_LANE(wrap_pos)(&readPos, &bufferSize, pow2);
+
+            idx = bufferOffset + readPos;
+
+            /* the read positions advance by about one sample per frame, fetch
+               ahead of one line per frame, each line twice per cache line */
+
+            if (prefetch) {
+                __builtin_prefetch((char *) mem
+                                   + (idx[i & (REVSC_LANES - 1)] + prefetch)
+                                     * sample_bytes(storage));
+            }
+
+            REVSC_LANE(gather_taps)(&v0, mem, &idx, storage);
+
+            if (interpolation == SP_REVSC_CUBIC) {
+
+                /* four contiguous taps from readPos - 1, guards cover both ends.
+                   Across lanes the coefficients are cheaper to compute than to
+                   gather from a table. */
+
+                idx -= 1;
+                REVSC_LANE(gather_taps)(&vm1, mem, &idx, storage);
+                idx += 2;
+                REVSC_LANE(gather_taps)(&v1, mem, &idx, storage);
+                idx += 1;
+                REVSC_LANE(gather_taps)(&v2, mem, &idx, storage);
+
+                frac = __builtin_convertvector(readPosFrac, lane_vf)
+                       * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                a2 = frac * frac; a2 -= 1; a2 *= (SPFLOAT) (1.0 / 6.0);
+                a1 = frac; a1 += 1; a1 *= (SPFLOAT) 0.5; am1 = a1 - 1;
+                a0 = 3 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
+
+                v0 = (am1 * vm1 + a0 * v0 + a1 * v1 + a2 * v2) * frac + v0;
+            } else if (interpolation == SP_REVSC_LINEAR) {
+                idx += 1;
+                REVSC_LANE(gather_taps)(&v1, mem, &idx, storage);
+                frac = __builtin_convertvector(readPosFrac, lane_vf)
+                       * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                v0 += (v1 - v0) * frac;
+            }
+
+            /* update buffer read position */
+
+            readPosFrac += readPosFrac_inc;
+
+            /* apply feedback gain and lowpass filter */
+
+            v0 *= feedback;
+            v0 = (filterState - v0) * dampFact + v0;
+            filterState = v0;
+
+            /* mix to output */
+
+            aoutL = REVSC_LANE(sum_lanes)(&v0, 0);
+            aoutR = REVSC_LANE(sum_lanes)(&v0, 1);
+            out1[i] = aoutL * gain;
+            out2[i] = aoutR * gain;
+        }
+
+        /* start next random line segments if any has reached its endpoint,
+           these are always queued by sp_revsc_compute_block() */
+
+        segLeft -= run;
+        if (segLeft == 0) {
+            for (n = 0; n < REVSC_LANES; n++) {
+                randLine_cnt[n] -= segStep;
+                if (randLine_cnt[n] <= 0) {
+                    pop_random_lineseg(p, lp, n);
+                    readPosFrac_inc[n] = lp->readPosFrac_inc[n];
+                    randLine_cnt[n] = lp->randLine_cnt[n];
+                }
+            }
+            segStep = randLine_cnt[0];
+            for (n = 1; n < REVSC_LANES; n++) {
+                if (randLine_cnt[n] < segStep) segStep = randLine_cnt[n];
+            }
+            segLeft = segStep;
+        }
+    }
+
+    for (n = 0; n < REVSC_LANES; n++) {
+        randLine_cnt[n] -= segStep - segLeft;
+    }
+
+    memcpy(lp->writePos, &writePos, sizeof(writePos));
+    memcpy(lp->readPos, &readPos, sizeof(readPos));
+    memcpy(lp->readPosFrac, &readPosFrac, sizeof(readPosFrac));
+    memcpy(lp->readPosFrac_inc, &readPosFrac_inc, sizeof(readPosFrac_inc));
+    memcpy(lp->filterState, &filterState, sizeof(filterState));
+    memcpy(lp->randLine_cnt, randLine_cnt, sizeof(randLine_cnt));
+    p->antiDenormal = dn;
+}
+
+/* Interpolated reads of line n for the frames of r. Within a random line
+   segment the position advances by readPosFrac_inc every frame, so each 8
+   frames are offsets from the first one. Taps past the end of a segment are
+   overwritten by the next one, and r->taps has room for 8 past the end. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(tb_read)(const revsc_tb *r, const int n, const int storage,
+                         const int pow2, const int interpolation)
+{
+    sp_revsc *p = r->p;
+    sp_revsc_dl *lp = &p->delayLines;
+    const void *mem = p->aux.ptr;
+    const int bufferSize = r->bufferSize[n];
+    const int bufferOffset = r->bufferOffset[n];
+    revsc_vi_8 ramp = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    revsc_vi_8 size = bufferSize + (revsc_vi_8) { 0 };
+    revsc_vi_8 pos, idx, posFrac;
+    revsc_vf_8 v0, vm1, v1, v2, frac, am1, a0, a1, a2;
+    int readPos = lp->readPos[n];
+    int readPosFrac = lp->readPosFrac[n];
+    int readPosFrac_inc = lp->readPosFrac_inc[n];
+    int randLine_cnt = lp->randLine_cnt[n];
+    uint32_t i, k, j, seg;
+
+    for (i = 0; i < r->frames; i += seg) {
+        seg = r->frames - i < (uint32_t) randLine_cnt ? r->frames - i : (uint32_t) randLine_cnt;
+
+        for (k = 0; k < seg; k += 8) {
+            posFrac = readPosFrac + ramp * (readPosFrac_inc - DELAYPOS_SCALE);
+            pos = readPos + ramp + (posFrac >> DELAYPOS_SHIFT);
+            REVSC_KERNEL(wrap_pos_8)(&pos, &size, pow2);
+            posFrac &= DELAYPOS_MASK;
+
+            idx = pos + bufferOffset;
+            REVSC_KERNEL(gather_taps_8)(&v0, mem, &idx, storage);
+
+            if (interpolation == SP_REVSC_CUBIC) {
+                idx -= 1;
+                REVSC_KERNEL(gather_taps_8)(&vm1, mem, &idx, storage);
+                idx += 2;
+                REVSC_KERNEL(gather_taps_8)(&v1, mem, &idx, storage);
+                idx += 1;
+                REVSC_KERNEL(gather_taps_8)(&v2, mem, &idx, storage);
+
+                frac = __builtin_convertvector(posFrac, revsc_vf_8)
+                       * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                a2 = frac * frac; a2 -= 1; a2 *= (SPFLOAT) (1.0 / 6.0);
+                a1 = frac; a1 += 1; a1 *= (SPFLOAT) 0.5; am1 = a1 - 1;
+                a0 = 3 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
+
+                v0 = (am1 * vm1 + a0 * v0 + a1 * v1 + a2 * v2) * frac + v0;
+            } else if (interpolation == SP_REVSC_LINEAR) {
+                idx += 1;
+                REVSC_KERNEL(gather_taps_8)(&v1, mem, &idx, storage);
+                frac = __builtin_convertvector(posFrac, revsc_vf_8)
+                       * (SPFLOAT) (1.0 / DELAYPOS_SCALE);
+                v0 += (v1 - v0) * frac;
+            }
+
+            if (r->lineMajor) {
+                memcpy(r->taps + n * (TB_PARALLEL_FRAMES + 8) + i + k, &v0, sizeof(v0));
+            } else {
+                for (j = 0; j < 8; j++) {
+                    r->taps[(i + k + j) * REVSC_LANES + n] = v0[j];
+                }
+            }
+
+            readPosFrac += 8 * (readPosFrac_inc - DELAYPOS_SCALE);
+            readPos += 8 + (readPosFrac >> DELAYPOS_SHIFT);
+            readPosFrac &= DELAYPOS_MASK;
+            if (pow2) {
+                readPos &= bufferSize - 1;
+            } else {
+                readPos -= bufferSize & -(readPos >= bufferSize);
+            }
+        }
+
+        /* state after the last frame of the segment, which is in the last
+           group of 8 */
+
+        readPos = pos[seg + 7 - k];
+        readPosFrac = posFrac[seg + 7 - k] + readPosFrac_inc;
+
+        /* segments are always queued by sp_revsc_compute_block() */
+
+        randLine_cnt -= seg;
+        if (randLine_cnt <= 0) {
+            pop_random_lineseg(p, lp, n);
+            readPosFrac_inc = lp->readPosFrac_inc[n];
+            randLine_cnt = lp->randLine_cnt[n];
+        }
+    }
+
+    lp->readPos[n] = readPos;
+    lp->readPosFrac[n] = readPosFrac;
+    lp->readPosFrac_inc[n] = readPosFrac_inc;
+    lp->randLine_cnt[n] = randLine_cnt;
+}
+
+/* Writes of line n for the written frames of r as up to two contiguous
+   stores, then the guards are refreshed from the samples they mirror */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(tb_write)(const revsc_tb *r, const int n, const int storage)
+{
+    sp_revsc_dl *lp = &r->p->delayLines;
+    const int bufferSize = r->bufferSize[n];
+    const int bytes = sample_bytes(storage);
+    char *line = (char *) r->p->aux.ptr + (size_t) r->bufferOffset[n] * bytes;
+    SPFLOAT column[TB_PARALLEL_FRAMES] __attribute__((aligned(64)));
+    uint16_t packed[TB_PARALLEL_FRAMES] __attribute__((aligned(64)));
+    const void *src = column;
+    int writePos = lp->writePos[n];
+    int first;
+    revsc_vf_8 v;
+    revsc_vi_8 w;
+    uint32_t i, j;
+
+    for (i = 0; i < r->written; i++) {
+        column[i] = r->ains[i * REVSC_LANES + n];
+    }
+
+    if (storage != SP_REVSC_FLOAT) {
+        for (i = 0; i < r->written; i += 8) {
+            memcpy(&v, column + i, sizeof(v));
+#if REVSC_ISA_F16C
+            if (storage == SP_REVSC_HALF) {
+                revsc_vf32_8 f = __builtin_convertvector(v, revsc_vf32_8);
+                REVSC_KERNEL(cvtps_ph_8)(packed + i, &f);
+                continue;
+            }
+#endif
+            REVSC_KERNEL(encode_taps_8)(&w, &v, storage);
+            for (j = 0; j < 8; j++) {
+                packed[i + j] = (uint16_t) w[j];
+            }
+        }
+        src = packed;
+    }
+
+    first = bufferSize - writePos < (int) r->written ? bufferSize - writePos : (int) r->written;
+    memcpy(line + (size_t) writePos * bytes, src, (size_t) first * bytes);
+    memcpy(line, (const char *) src + (size_t) first * bytes, (size_t) (r->written - first) * bytes);
+    writePos += r->written;
+    if (writePos >= bufferSize) writePos -= bufferSize;
+    lp->writePos[n] = writePos;
+
+    memcpy(line - DELAY_GUARD * bytes, line + (bufferSize - DELAY_GUARD) * bytes,
+           DELAY_GUARD * bytes);
+    memcpy(line + bufferSize * bytes, line, DELAY_GUARD * bytes);
+}
+
+/* Task n of a run, the writes of the previous run and the reads of the next
+   one for line n. Each kernel has its own copy for sp_revsc.parallel, see
+   TB_VARIANT. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(tb_task)(void *arg, int n, const int storage, const int pow2,
+                         const int interpolation)
+{
+    const revsc_tb *r = arg;
+
+    if (r->written > 0) {
+        REVSC_LANE(tb_write)(r, n, storage);
+    }
+    if (r->frames > 0) {
+        REVSC_LANE(tb_read)(r, n, storage, pow2, interpolation);
+    }
+}
+
+/* tb_task() for every line, through sp_revsc.parallel or on this thread */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(tb_tasks)(sp_revsc *p, revsc_tb *r, sp_revsc_task task, const int parallel,
+                          const int storage, const int pow2, const int interpolation)
+{
+    int n;
+
+    if (parallel) {
+        p->parallel(p->parallelData, task, r, REVSC_LANES);
+    } else {
+        for (n = 0; n < REVSC_LANES; n++) {
+            REVSC_LANE(tb_task)(r, n, storage, pow2, interpolation);
+        }
+    }
+}
+
+/* Time blocked implementation. A read lands at least the shortest delay
+   behind the write position, so within runs of up to tb_frames() frames
+   every read is of samples written before the run. Each run takes three
+   passes: the interpolated reads of one line at a time, vectorized over 8
+   frames, then the feedback filters and the junction frame by frame,
+   vectorized over the lines, then the writes of one line at a time as
+   contiguous stores. The arithmetic per frame and line is the same as in
+   compute_block_simd(), but the compiler is free to contract and reorder
+   it differently, so the output is only the same within rounding, see
+   tests/revsc_time_blocked.c. The taps and inputs go through a transpose,
+   which costs about what the serial part saves: with AVX2 gathers this is
+   up to 25% faster, with AVX-512 or without gathers and float storage up
+   to 25% slower.
+
+   The writes of one run and the reads of the next one are a single task
+   per line. With sp_revsc.parallel the tasks of the lines run on its
+   threads and the runs are as long as the shortest delay allows. The task
+   is the same code with and without it, and so is the output, bit for bit,
+   tests/revsc_time_blocked.c checks this too. */
+
+static inline __attribute__((always_inline))
+void REVSC_LANE(compute_block_tb)(sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+                                  SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes,
+                                  const revsc_ctl *ctl, sp_revsc_task task, const int storage,
+                                  const int pow2, const int interpolation)
+{
+    SPFLOAT taps[(TB_FRAMES + 8) * REVSC_LANES] __attribute__((aligned(64)));
+    SPFLOAT ains[TB_FRAMES * REVSC_LANES] __attribute__((aligned(64)));
+    SPFLOAT dampFact = ctl->dampFact;
+    SPFLOAT feedback = ctl->feedback;
+    const SPFLOAT jpScale = junction_scale(REVSC_LANES);
+    const SPFLOAT gain = output_gain(REVSC_LANES);
+    const int parallel = p->parallel != NULL && p->parallelAux.ptr != NULL;
+    lane_vf evenLanes, oddLanes, ain, v0, filterState;
+    lane_vi tapStart, tapIdx;
+    SPFLOAT ainL, ainR, aoutL, aoutR;
+    SPFLOAT dn = p->antiDenormal;
+    sp_revsc_dl *lp = &p->delayLines;
+    int bufferSize[REVSC_LANES], bufferOffset[REVSC_LANES];
+    uint32_t start, run, maxRun, i;
+    revsc_tb r;
+    int n;
+
+    for (n = 0; n < REVSC_LANES; n++) {
+        evenLanes[n] = (n & 1) ? 0 : 1;
+        oddLanes[n] = (n & 1) ? 1 : 0;
+        tapStart[n] = n * (TB_PARALLEL_FRAMES + 8);
+        bufferSize[n] = lp->bufferSize[n];
+        bufferOffset[n] = lp->bufferOffset[n];
+    }
+    memcpy(&filterState, lp->filterState, sizeof(filterState));
+    aoutL = REVSC_LANE(sum_lanes)(&filterState, 0);
+    aoutR = REVSC_LANE(sum_lanes)(&filterState, 1);
+
+    r.p = p;
+    r.bufferSize = bufferSize;
+    r.bufferOffset = bufferOffset;
+    r.written = 0;
+    r.lineMajor = parallel;
+    if (parallel) {
+        r.taps = p->parallelAux.ptr;
+        r.ains = r.taps + (TB_PARALLEL_FRAMES + 8) * REVSC_LANES;
+        maxRun = tb_frames(p, TB_PARALLEL_FRAMES);
+    } else {
+        r.taps = taps;
+        r.ains = ains;
+        maxRun = tb_frames(p, TB_FRAMES);
+    }
+
+    for (start = 0; start < nframes; start += run) {
+        run = nframes - start < maxRun ? nframes - start : maxRun;
+        r.frames = run;
+
+        REVSC_LANE(tb_tasks)(p, &r, task, parallel, storage, pow2, interpolation);
+
+        /* feedback filters and junction, the only serial part */
+
+        for (i = 0; i < run; i++) {
+            dampFact += ctl->dampStep;
+            feedback += ctl->feedbackStep;
+
+            ainL = (aoutL + aoutR) * jpScale + dn;
+            dn = -dn;
+            ainR = ainL + in2[start + i];
+            ainL = ainL + in1[start + i];
+            ain = evenLanes * ainL + oddLanes * ainR - filterState;
+            memcpy(r.ains + i * REVSC_LANES, &ain, sizeof(ain));
+
+            if (parallel) {
+                tapIdx = tapStart + (int) i;
+                REVSC_LANE(gather_taps)(&v0, r.taps, &tapIdx, SP_REVSC_FLOAT);
+            } else {
+                memcpy(&v0, r.taps + i * REVSC_LANES, sizeof(v0));
+            }
+            v0 *= feedback;
+            v0 = (filterState - v0) * dampFact + v0;
+            filterState = v0;
+
+            aoutL = REVSC_LANE(sum_lanes)(&v0, 0);
+            aoutR = REVSC_LANE(sum_lanes)(&v0, 1);
+            out1[start + i] = aoutL * gain;
+            out2[start + i] = aoutR * gain;
+        }
+
+        r.written = run;
+    }
+
+    /* writes of the last run */
+
+    r.frames = 0;
+    REVSC_LANE(tb_tasks)(p, &r, task, parallel, storage, pow2, interpolation);
+
+    memcpy(lp->filterState, &filterState, sizeof(filterState));
+    p->antiDenormal = dn;
+}
+
+#if REVSC_LANES == 8
+SIMD_RATE_VARIANTS(0)
+SIMD_RATE_VARIANTS(1)
+SIMD_RATE_VARIANTS(2)
+SIMD_RATE_VARIANTS(3)
+SIMD_RATE_VARIANTS(4)
+SIMD_RATE_VARIANTS(5)
+#else
+SIMD_STORAGE_VARIANTS(float, SP_REVSC_FLOAT)
+#endif
+SIMD_STORAGE_VARIANTS(half,  SP_REVSC_HALF)
+SIMD_STORAGE_VARIANTS(int16, SP_REVSC_INT16)
+TB_STORAGE_VARIANTS(float, SP_REVSC_FLOAT)
+TB_STORAGE_VARIANTS(half,  SP_REVSC_HALF)
+TB_STORAGE_VARIANTS(int16, SP_REVSC_INT16)
+
+#undef lane_vf
+#undef lane_vi
+#undef lane_vf32
+#undef REVSC_LANES
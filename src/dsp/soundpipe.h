@@ -16,6 +16,12 @@
 
 #define SP_RANDMAX 2147483648
 
+#if defined(__GNUC__)
+#define SP_ALIGNED(n) __attribute__((aligned(n)))
+#else
+#define SP_ALIGNED(n)
+#endif
+
 typedef unsigned long sp_frame;
 
 typedef struct sp_auxdata {
@@ -1203,34 +1209,239 @@ typedef struct{
 size_t size;
 void *auxp;
 }auxData;
-typedef struct {
-    int     writePos;
-    int     bufferSize;
-    int     readPos;
-    int     readPosFrac;
-    int     readPosFrac_inc;
-    int     dummy;
-    int     seedVal;
-    int     randLine_cnt;
-    SPFLOAT filterState;
-    SPFLOAT *buf;
+/* Number of delay lines is 4, 8 (default) or 16 */
+#define SP_REVSC_MAX_LINES 16
+
+/* Delay line state as parallel arrays, one element per line. The arrays are
+   iLines long and packed in one cache line aligned block at the end of
+   aux, per-sample state first, so that 8 lines take 4 cache lines. */
+
+typedef struct {
+    SPFLOAT *filterState;
+    int     *writePos;
+    int     *readPos;
+    int     *readPosFrac;
+    /* current random line segment */
+    int     *readPosFrac_inc;
+    int     *randLine_cnt;
+    /* fixed after init, bufferOffset is in samples from aux.ptr */
+    int     *bufferSize;
+    int     *bufferOffset;
 } sp_revsc_dl;
 
+/* Upcoming random line segments of each line as a ring, refilled once per
+   block. delay is where the last queued segment ends, in 1/2^28 samples,
+   seed is the random seed each segment was drawn from. */
+
+#define SP_REVSC_SEGMENTS 4
+
+typedef struct {
+    int     count[SP_REVSC_SEGMENTS][SP_REVSC_MAX_LINES];
+    int     inc[SP_REVSC_SEGMENTS][SP_REVSC_MAX_LINES];
+    int     seed[SP_REVSC_SEGMENTS][SP_REVSC_MAX_LINES];
+    int     head[SP_REVSC_MAX_LINES];
+    int     queued[SP_REVSC_MAX_LINES];
+    int64_t delay[SP_REVSC_MAX_LINES];
+} sp_revsc_seg;
+
+/* Interpolation of the delay line taps. With SP_REVSC_NONE the read position
+   is truncated to a whole sample, which is only free of zipper noise when the
+   delay does not move, see iPitchMod. */
+#define SP_REVSC_NONE   0
+#define SP_REVSC_LINEAR 1
+#define SP_REVSC_CUBIC  3
+
+/* Delay line sample formats. Half floats and scaled 16 bit integers halve
+   the delay memory and raise the noise floor, arithmetic stays in SPFLOAT.
+   Against float storage, half floats keep an SNR of about 69 dB at any level
+   and 16 bit integers add an error of about -72 dBFS, see
+   tests/revsc_storage.c. */
+#define SP_REVSC_FLOAT  0
+#define SP_REVSC_HALF   1
+#define SP_REVSC_INT16  2
+
+/* Default prefetch distance of sp_revsc_bank. The 8 read streams of a single
+   sp_revsc are left to the hardware prefetcher, which handles them better. */
+#define SP_REVSC_PREFETCH 64
+
+/* Runs task(arg, n) for n from 0 to count - 1, in any order and on any
+   threads, and returns once all of them have returned. The delay lines of
+   an sp_revsc can be run this way, see sp_revsc.parallel. */
+typedef void (*sp_revsc_task)(void *arg, int n);
+typedef void (*sp_revsc_parallel)(void *data, sp_revsc_task task, void *arg, int count);
+
 typedef struct  {
+    sp_revsc_dl delayLines;
     SPFLOAT feedback, lpfreq;
     SPFLOAT iSampleRate, iPitchMod, iSkipInit;
     SPFLOAT sampleRate;
     SPFLOAT dampFact;
     SPFLOAT prv_LPFreq;
+    SPFLOAT prv_Feedback;
+    SPFLOAT antiDenormal;
     int initDone;
-    sp_revsc_dl delayLines[8];
+    /* SP_REVSC_NONE, SP_REVSC_LINEAR or SP_REVSC_CUBIC, defaults to cubic */
+    int interpolation;
+    /* iPitchMod scales the random variation of the delay times from 0 (off)
+       to 1 (default). Can be changed between blocks, the variation then
+       restarts from the current delays. */
+    SPFLOAT prv_PitchMod;
+    /* set before sp_revsc_init() to round delay lines up to a power of two */
+    int iPow2Size;
+    /* set before sp_revsc_init(), 4, 8 (default) or 16 delay lines */
+    int iLines;
+    /* set before sp_revsc_init(), SP_REVSC_FLOAT (default), _HALF or _INT16 */
+    int iStorage;
+    /* set before sp_revsc_init() to allocate for sp_revsc_reset() up to this rate */
+    SPFLOAT iMaxSampleRate;
+    /* kernels specialized for sampleRate if any, picked by sp_revsc_reset() */
+    int rateVariant;
+    /* frames ahead of the read positions to prefetch, defaults to 0 (none) */
+    int prefetch;
+    /* 1 to run the time blocked kernels, defaults to 0. Same output within
+       rounding, faster or slower depending on the CPU, see
+       compute_block_tb(). */
+    int timeBlocked;
+    /* set before sp_revsc_init() to allocate the buffers needed by parallel,
+       or call sp_revsc_init_parallel() later */
+    int iParallel;
+    /* with timeBlocked set, reads and writes the delay lines one task per
+       line through parallel(parallelData, ...) if not NULL, in runs as long
+       as the shortest delay allows. Same output as without it, bit for bit. */
+    sp_revsc_parallel parallel;
+    void *parallelData;
+    sp_auxdata parallelAux;
     sp_auxdata aux;
+    sp_revsc_seg segments;
+    /* only used when scheduling a new random line segment */
+    int seedVal[SP_REVSC_MAX_LINES];
 } sp_revsc;
 
 int sp_revsc_create(sp_revsc **p);
 int sp_revsc_destroy(sp_revsc **p);
 int sp_revsc_init(sp_data *sp, sp_revsc *p);
+int sp_revsc_init_parallel(sp_revsc *p);
+int sp_revsc_reset(sp_data *sp, sp_revsc *p);
+int sp_revsc_relayout(sp_data *sp, sp_revsc *p);
 int sp_revsc_compute(sp_data *sp, sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2, SPFLOAT *out1, SPFLOAT *out2);
+int sp_revsc_compute_block(sp_data *sp, sp_revsc *p, SPFLOAT *in1, SPFLOAT *in2,
+        SPFLOAT *out1, SPFLOAT *out2, uint32_t nframes);
+SPFLOAT sp_revsc_peak(sp_revsc *p);
+int sp_revsc_max_delay(sp_revsc *p);
+
+/* Parameters and delay line math of the network, for RevSC.hpp. Computed in
+   revsc.c so that read positions match sp_revsc whatever the floating point
+   flags of the caller.
+   sp_revsc_params[n][0] = delay time (in seconds)
+   sp_revsc_params[n][1] = random variation in delay time (in seconds)
+   sp_revsc_params[n][2] = random variation frequency (in 1/sec)
+   sp_revsc_params[n][3] = random seed (0 - 32767) */
+
+extern const SPFLOAT sp_revsc_params[SP_REVSC_MAX_LINES][4];
+int sp_revsc_line_samples(SPFLOAT sr, SPFLOAT iPitchMod, int n);
+void sp_revsc_line_start(SPFLOAT sr, SPFLOAT iPitchMod, int n, int bufferSize, int *seed,
+                         int *readPos, int *readPosFrac);
+int sp_revsc_line_segment(SPFLOAT sr, SPFLOAT iPitchMod, int n, int *seed, int64_t *delay,
+                          int *inc);
+
+/* Independent reverbs at the same rate processed together, one SIMD lane per
+   member. Parameters are set on the members, the options below are copied to
+   all of them by sp_revsc_bank_init(), which also allocates the delay memory
+   of all members as one block. The output is that of separate instances bit
+   for bit, see tests/revsc_bank.c. With 8 to 32 members of 8 lines at 48 kHz
+   the throughput against separate instances is about 1.2 times with AVX2,
+   the same with AVX-512, whose single instance kernels scatter, and 0.97
+   times with the generic kernels, which have no bank kernel. */
+
+typedef struct {
+    int size;
+    sp_revsc **revsc;
+    int interpolation;
+    int iPow2Size;
+    int iLines;
+    int iStorage;
+    SPFLOAT iMaxSampleRate;
+    int prefetch;
+    int initDone;
+    sp_auxdata aux;
+} sp_revsc_bank;
+
+int sp_revsc_bank_create(sp_revsc_bank **p, int size);
+int sp_revsc_bank_destroy(sp_revsc_bank **p);
+int sp_revsc_bank_init(sp_data *sp, sp_revsc_bank *p);
+int sp_revsc_bank_reset(sp_data *sp, sp_revsc_bank *p);
+int sp_revsc_bank_compute_block(sp_data *sp, sp_revsc_bank *p, SPFLOAT **in1, SPFLOAT **in2,
+        SPFLOAT **out1, SPFLOAT **out2, uint32_t nframes);
+
+/* Fixed point sp_revsc with integer arithmetic only in the processing, the
+   output is the same on any machine. Inputs and outputs are Q31, inside the
+   network samples keep 5 bits of headroom like the float delay lines.
+   Against RevSC<double> the SNR is about 62 dB for Q31 storage and 43 dB
+   for Q15, 72 and 45 dB without pitch modulation, for noise at -18 dBFS at
+   44.1 and 48 kHz. Most of the Q31 difference is in the delay times, which
+   sp_revsc and RevSC round to SPFLOAT. Q15 is limited by its storage like
+   SP_REVSC_INT16. The output saturates at full scale. See
+   tests/revsc_fixed.cpp. On x86 it takes about 4.5 to 5.5 times the CPU time
+   of the float SIMD kernels, Q15 more, see bench/revsc_fixed.cpp. */
+
+/* Delay line formats of sp_revsc_fixed, 32 bit words or 16 bit words with
+   the same scaling as SP_REVSC_INT16 */
+#define SP_REVSC_Q31 0
+#define SP_REVSC_Q15 1
+
+/* Delay line state of sp_revsc_fixed, samples in 1/2^26 and positions like
+   in sp_revsc_dl */
+
+typedef struct {
+    int32_t filterState[SP_REVSC_MAX_LINES];
+    int     writePos[SP_REVSC_MAX_LINES];
+    int     readPos[SP_REVSC_MAX_LINES];
+    int     readPosFrac[SP_REVSC_MAX_LINES];
+    int     readPosFrac_inc[SP_REVSC_MAX_LINES];
+    int     randLine_cnt[SP_REVSC_MAX_LINES];
+    int     bufferSize[SP_REVSC_MAX_LINES];
+    int     bufferOffset[SP_REVSC_MAX_LINES];
+} sp_revsc_fixed_dl;
+
+typedef struct {
+    sp_revsc_fixed_dl delayLines;
+    /* same as in sp_revsc, converted to fixed point once per block */
+    SPFLOAT feedback, lpfreq;
+    /* SP_REVSC_NONE, SP_REVSC_LINEAR or SP_REVSC_CUBIC, defaults to cubic */
+    int interpolation;
+    /* set before sp_revsc_fixed_init(), 4, 8 (default) or 16 delay lines */
+    int iLines;
+    /* set before sp_revsc_fixed_init(), SP_REVSC_Q31 (default) or _Q15 */
+    int iStorage;
+    /* set before sp_revsc_fixed_init() or _reset(), random variation of the
+       delay times in Q15 from 0 (off) to 32768 (default) */
+    int iPitchMod;
+    /* set before sp_revsc_fixed_init() to allocate for sp_revsc_fixed_reset()
+       up to this rate */
+    SPFLOAT iMaxSampleRate;
+    int sampleRate;
+    int initDone;
+    SPFLOAT prv_LPFreq;
+    /* Q31, values reached by the last block */
+    int32_t dampFact, prv_Feedback;
+    /* random line segments, delays in 1/2^28 samples. delay is where the
+       current segment ends. */
+    int     seedVal[SP_REVSC_MAX_LINES];
+    int     segLength[SP_REVSC_MAX_LINES];
+    int64_t baseDelay[SP_REVSC_MAX_LINES];
+    int64_t modDepth[SP_REVSC_MAX_LINES];
+    int64_t delay[SP_REVSC_MAX_LINES];
+    sp_auxdata aux;
+} sp_revsc_fixed;
+
+int sp_revsc_fixed_create(sp_revsc_fixed **p);
+int sp_revsc_fixed_destroy(sp_revsc_fixed **p);
+int sp_revsc_fixed_init(sp_data *sp, sp_revsc_fixed *p);
+int sp_revsc_fixed_reset(sp_data *sp, sp_revsc_fixed *p);
+int sp_revsc_fixed_compute(sp_data *sp, sp_revsc_fixed *p, int32_t *in1, int32_t *in2,
+        int32_t *out1, int32_t *out2);
+int sp_revsc_fixed_compute_block(sp_data *sp, sp_revsc_fixed *p, int32_t *in1, int32_t *in2,
+        int32_t *out1, int32_t *out2, uint32_t nframes);
 typedef struct sp_rms{
     SPFLOAT ihp, istor;
     SPFLOAT c1, c2, prvq;
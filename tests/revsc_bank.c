@@ -0,0 +1,169 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Every member of an sp_revsc_bank must give the output of a separate
+   sp_revsc with the same settings and input, bit for bit. 11 members make
+   one group for the bank kernel and 3 left for sp_revsc_compute_block(),
+   each with its own input, feedback and low pass. Halfway through, one
+   member of each kind moves its low pass and one its pitch modulation.
+   Runs for every storage, interpolation and iPow2Size with 8 lines, and
+   with 4 lines, where the whole bank goes through the single instance
+   kernels. SP_REVSC_ISA picks the kernels like for any sp_revsc. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "soundpipe.h"
+
+#define SRATE   48000
+#define BLOCK   256
+#define MEMBERS 11
+#define FRAMES  (2 * SRATE)
+
+static const int storages[] = { SP_REVSC_FLOAT, SP_REVSC_HALF, SP_REVSC_INT16 };
+static const int interpolations[] = { SP_REVSC_NONE, SP_REVSC_LINEAR, SP_REVSC_CUBIC };
+static const int lineCounts[] = { 8, 4 };
+
+/* settings of member m, the same for the bank and the separate instance */
+
+static void set_member(sp_revsc *p, int m)
+{
+    p->feedback = 0.9 + 0.008 * m;
+    p->lpfreq = 4000 + 1000 * m;
+}
+
+static void change_member(sp_revsc *p, int m)
+{
+    if (m == 2 || m == 9) p->lpfreq = 2000;
+    if (m == 5 || m == 10) p->iPitchMod = 0.5;
+}
+
+static void render_bank(int lines, int storage, int interpolation, int pow2,
+                        SPFLOAT **in, SPFLOAT **out1, SPFLOAT **out2)
+{
+    SPFLOAT *bin[MEMBERS], *bout1[MEMBERS], *bout2[MEMBERS];
+    sp_data *sp;
+    sp_revsc_bank *p;
+    int b, m;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_bank_create(&p, MEMBERS);
+    p->iLines = lines;
+    p->iStorage = storage;
+    p->iPow2Size = pow2;
+    p->interpolation = interpolation;
+    sp_revsc_bank_init(sp, p);
+    for (m = 0; m < MEMBERS; m++) set_member(p->revsc[m], m);
+
+    for (b = 0; b < FRAMES / BLOCK; b++) {
+        if (b == FRAMES / BLOCK / 2) {
+            for (m = 0; m < MEMBERS; m++) change_member(p->revsc[m], m);
+        }
+        for (m = 0; m < MEMBERS; m++) {
+            bin[m] = in[m] + b * BLOCK;
+            bout1[m] = out1[m] + b * BLOCK;
+            bout2[m] = out2[m] + b * BLOCK;
+        }
+        sp_revsc_bank_compute_block(sp, p, bin, bin, bout1, bout2, BLOCK);
+    }
+
+    sp_revsc_bank_destroy(&p);
+    sp_destroy(&sp);
+}
+
+static void render_single(int lines, int storage, int interpolation, int pow2, int m,
+                          SPFLOAT *in, SPFLOAT *out1, SPFLOAT *out2)
+{
+    sp_data *sp;
+    sp_revsc *p;
+    int b;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    p->iLines = lines;
+    p->iStorage = storage;
+    p->iPow2Size = pow2;
+    sp_revsc_init(sp, p);
+    p->interpolation = interpolation;
+    set_member(p, m);
+
+    for (b = 0; b < FRAMES / BLOCK; b++) {
+        if (b == FRAMES / BLOCK / 2) change_member(p, m);
+        sp_revsc_compute_block(sp, p, in + b * BLOCK, in + b * BLOCK, out1 + b * BLOCK,
+                               out2 + b * BLOCK, BLOCK);
+    }
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(void)
+{
+    SPFLOAT *in[MEMBERS], *out1[MEMBERS], *out2[MEMBERS];
+    SPFLOAT *ref1 = malloc(sizeof(SPFLOAT) * FRAMES);
+    SPFLOAT *ref2 = malloc(sizeof(SPFLOAT) * FRAMES);
+    size_t l, s, i;
+    int pow2, m, k, differ, configs = 0, matches = 0;
+    uint32_t seed = 1;
+
+    for (m = 0; m < MEMBERS; m++) {
+        in[m] = calloc(FRAMES, sizeof(SPFLOAT));
+        out1[m] = malloc(sizeof(SPFLOAT) * FRAMES);
+        out2[m] = malloc(sizeof(SPFLOAT) * FRAMES);
+        for (k = 0; k < SRATE; k++) {
+            seed = seed * 1664525 + 1013904223;
+            in[m][k] = (SPFLOAT) (seed >> 8) / 16777216 - 0.5;
+        }
+    }
+
+    for (l = 0; l < sizeof(lineCounts) / sizeof(lineCounts[0]); l++)
+    for (s = 0; s < sizeof(storages) / sizeof(storages[0]); s++)
+    for (i = 0; i < sizeof(interpolations) / sizeof(interpolations[0]); i++)
+    for (pow2 = 0; pow2 < 2; pow2++) {
+        render_bank(lineCounts[l], storages[s], interpolations[i], pow2, in, out1, out2);
+
+        differ = -1;
+        for (m = 0; m < MEMBERS && differ < 0; m++) {
+            render_single(lineCounts[l], storages[s], interpolations[i], pow2, m, in[m],
+                          ref1, ref2);
+            if (memcmp(out1[m], ref1, sizeof(SPFLOAT) * FRAMES) != 0
+                || memcmp(out2[m], ref2, sizeof(SPFLOAT) * FRAMES) != 0) differ = m;
+        }
+
+        configs++;
+        if (differ < 0) {
+            matches++;
+        } else {
+            printf("FAIL, lines %d storage %d interpolation %d pow2 %d: member %d differs\n",
+                   lineCounts[l], storages[s], interpolations[i], pow2, differ);
+        }
+    }
+
+    printf("%d of %d configurations match\n", matches, configs);
+
+    for (m = 0; m < MEMBERS; m++) {
+        free(in[m]);
+        free(out1[m]);
+        free(out2[m]);
+    }
+    free(ref1);
+    free(ref2);
+    return matches != configs;
+}
@@ -0,0 +1,187 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Output of sp_revsc_fixed. Its hash has to match the recorded one on any
+// machine and with any compiler flags, also after sp_revsc_fixed_reset() and
+// after a reset to a lower rate. The SNR against RevSC<double>, at the same
+// settings and read positions, has to stay above the figures documented in
+// soundpipe.h. The input is 1 second of noise at -18 dBFS, the output would
+// saturate above that, and the low pass moves to 4 kHz halfway through the
+// tail. Cases run with and without pitch modulation.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "RevSC.hpp"
+
+#define SRATE   48000
+#define BLOCK   256
+#define SECONDS 5
+
+struct FixedCase
+{
+    const char* name;
+    int         storage;
+    int         sampleRate;
+    int         pitchMod;   // Q15
+    uint32_t    hash;
+    double      minSnr;     // dB
+};
+
+static const FixedCase cases[] = {
+    { "q31", SP_REVSC_Q31, 48000, 32768, 0x4499d185, 58 },
+    { "q15", SP_REVSC_Q15, 48000, 32768, 0xd349a8a0, 40 },
+    { "q31", SP_REVSC_Q31, 44100, 32768, 0x79a8ddca, 58 },
+    { "q15", SP_REVSC_Q15, 44100, 32768, 0x2a648109, 40 },
+    { "q31", SP_REVSC_Q31, 48000, 0,     0x3c09389b, 68 },
+    { "q15", SP_REVSC_Q15, 48000, 0,     0x3928e9f6, 41 },
+    { "q31", SP_REVSC_Q31, 44100, 0,     0xbe9a844b, 68 },
+    { "q15", SP_REVSC_Q15, 44100, 0,     0xdd62a362, 41 }
+};
+
+static const int frames = SRATE * SECONDS;
+
+static uint32_t fnv1a(const std::vector<int32_t>& x)
+{
+    uint32_t h = 2166136261u;
+
+    for (int32_t v : x) {
+        for (int b = 0; b < 32; b += 8) {
+            h = (h ^ (((uint32_t) v >> b) & 0xff)) * 16777619u;
+        }
+    }
+    return h;
+}
+
+static void render_fixed(sp_data* sp, sp_revsc_fixed* p, const std::vector<int32_t>& in,
+                         std::vector<int32_t>& out)
+{
+    std::vector<int32_t> l(in), r(in);
+
+    out.resize(2 * frames);
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        if (i / BLOCK == frames / 2 / BLOCK) p->lpfreq = 4000;
+        sp_revsc_fixed_compute_block(sp, p, &l[i], &r[i], &out[i], &out[frames + i], n);
+    }
+}
+
+// fresh init at the rate of the case, then the same again after a reset, and
+// after a reset from a 48 kHz instance
+
+static bool run_fixed(const FixedCase& c, const std::vector<int32_t>& in, std::vector<int32_t>& out)
+{
+    std::vector<int32_t> again;
+    sp_data* sp;
+    sp_revsc_fixed* p;
+    bool same;
+
+    sp_create(&sp);
+    sp->sr = c.sampleRate;
+    sp_revsc_fixed_create(&p);
+    p->iStorage = c.storage;
+    p->iPitchMod = c.pitchMod;
+    sp_revsc_fixed_init(sp, p);
+    render_fixed(sp, p, in, out);
+
+    p->lpfreq = 10000;
+    sp_revsc_fixed_reset(sp, p);
+    render_fixed(sp, p, in, again);
+    same = out == again;
+    sp_revsc_fixed_destroy(&p);
+
+    sp->sr = SRATE;
+    sp_revsc_fixed_create(&p);
+    p->iStorage = c.storage;
+    p->iPitchMod = c.pitchMod;
+    sp_revsc_fixed_init(sp, p);
+    render_fixed(sp, p, in, again);
+    sp->sr = c.sampleRate;
+    p->lpfreq = 10000;
+    sp_revsc_fixed_reset(sp, p);
+    render_fixed(sp, p, in, again);
+    same = same && out == again;
+    sp_revsc_fixed_destroy(&p);
+
+    sp_destroy(&sp);
+    return same;
+}
+
+static void run_double(const FixedCase& c, const std::vector<int32_t>& in, std::vector<double>& out)
+{
+    std::vector<double> x(frames);
+    RevSC<double> rev;
+
+    for (int i = 0; i < frames; i++) x[i] = in[i] / 2147483648.0;
+    rev.pitchMod = c.pitchMod / 32768.0;
+    rev.init(c.sampleRate, c.sampleRate);
+
+    out.resize(2 * frames);
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        if (i / BLOCK == frames / 2 / BLOCK) rev.lpfreq = 4000;
+        rev.process(&x[i], &x[i], &out[i], &out[frames + i], n);
+    }
+}
+
+static double snr(const std::vector<double>& ref, const std::vector<int32_t>& x)
+{
+    double sig = 0, err = 0;
+
+    for (size_t i = 0; i < ref.size(); i++) {
+        double e = x[i] / 2147483648.0 - ref[i];
+        sig += ref[i] * ref[i];
+        err += e * e;
+    }
+    return err > 0 ? 10 * std::log10(sig / err) : INFINITY;
+}
+
+int main()
+{
+    std::vector<int32_t> in(frames, 0), out;
+    std::vector<double> ref;
+    uint32_t seed = 1;
+    bool failed = false;
+
+    for (int i = 0; i < SRATE; i++) {
+        seed = seed * 1664525 + 1013904223;
+        in[i] = (int32_t) (seed & 0xffffff00) >> 3;
+    }
+
+    printf("%-6s %6s %5s %10s %8s %6s\n", "format", "rate", "pm", "hash", "SNR dB", "reset");
+
+    for (const FixedCase& c : cases) {
+        bool same = run_fixed(c, in, out);
+        uint32_t hash = fnv1a(out);
+        run_double(c, in, ref);
+        double s = snr(ref, out);
+
+        printf("%-6s %6d %5d %10x %8.1f %6s", c.name, c.sampleRate, c.pitchMod, hash, s,
+               same ? "same" : "differ");
+        if (hash != c.hash || s < c.minSnr || !same) {
+            printf("  FAIL, expected hash %x, SNR >= %.0f dB and the same output after reset",
+                   c.hash, c.minSnr);
+            failed = true;
+        }
+        printf("\n");
+    }
+
+    return failed;
+}
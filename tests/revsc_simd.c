@@ -0,0 +1,135 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* SIMD kernels against the scalar one. This is built twice, revsc_simd with
+   the default kernels and revsc_simd_scalar with revsc.c built with
+   SP_REVSC_NO_SIMD, which writes its output to stdout when run with -raw.
+   revsc_simd runs it and compares, for every number of lines and
+   interpolation, 1 second of noise and its tail. The difference comes from
+   the order the junction and the outputs are summed in, it has to stay
+   within the figures documented in revsc_lanes.h. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "soundpipe.h"
+
+#define SRATE   48000
+#define BLOCK   256
+#define SECONDS 3
+#define FRAMES  (SECONDS * SRATE)
+
+typedef struct {
+    const char *name;
+    int interpolation;
+    double minSnr;      /* dB */
+    double maxDiff;
+} simd_case;
+
+static const simd_case cases[] = {
+    { "none",   SP_REVSC_NONE,   125, 1e-6 },
+    { "linear", SP_REVSC_LINEAR, 125, 1e-6 },
+    { "cubic",  SP_REVSC_CUBIC,  125, 1e-6 }
+};
+
+static const int lineCounts[] = { 4, 8, 16 };
+
+static void render(int lines, int interpolation, SPFLOAT *out)
+{
+    static SPFLOAT in[BLOCK];
+    sp_data *sp;
+    sp_revsc *p;
+    uint32_t seed = 1;
+    int b, i;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    p->iLines = lines;
+    sp_revsc_init(sp, p);
+    p->interpolation = interpolation;
+
+    for (b = 0; b < FRAMES / BLOCK; b++) {
+        for (i = 0; i < BLOCK; i++) {
+            seed = seed * 1664525 + 1013904223;
+            in[i] = b < SRATE / BLOCK ? (SPFLOAT) (seed >> 8) / 16777216 - 0.5 : 0;
+        }
+        sp_revsc_compute_block(sp, p, in, in, out + b * BLOCK, out + FRAMES + b * BLOCK,
+                               BLOCK);
+    }
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(int argc, char **argv)
+{
+    const int raw = argc > 1 && strcmp(argv[1], "-raw") == 0;
+    SPFLOAT *ref = malloc(sizeof(SPFLOAT) * 2 * FRAMES);
+    SPFLOAT *out = malloc(sizeof(SPFLOAT) * 2 * FRAMES);
+    FILE *scalar = NULL;
+    double sig, err, snr, diff;
+    size_t c, l;
+    int i, failed = 0;
+
+    if (!raw) {
+        scalar = popen("./revsc_simd_scalar -raw", "r");
+        if (scalar == NULL) {
+            printf("FAIL, cannot run revsc_simd_scalar\n");
+            return 1;
+        }
+        printf("%-6s %5s %8s %10s\n", "interp", "lines", "SNR dB", "max diff");
+    }
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    for (l = 0; l < sizeof(lineCounts) / sizeof(lineCounts[0]); l++) {
+        render(lineCounts[l], cases[c].interpolation, out);
+
+        if (raw) {
+            fwrite(out, sizeof(SPFLOAT), 2 * FRAMES, stdout);
+            continue;
+        }
+        if (fread(ref, sizeof(SPFLOAT), 2 * FRAMES, scalar) != 2 * FRAMES) {
+            printf("FAIL, short output from revsc_simd_scalar\n");
+            failed = 1;
+            break;
+        }
+
+        sig = err = diff = 0;
+        for (i = 0; i < 2 * FRAMES; i++) {
+            sig += (double) ref[i] * ref[i];
+            err += ((double) out[i] - ref[i]) * ((double) out[i] - ref[i]);
+            if (fabs((double) out[i] - ref[i]) > diff) diff = fabs((double) out[i] - ref[i]);
+        }
+        snr = err > 0 ? 10 * log10(sig / err) : INFINITY;
+
+        printf("%-6s %5d %8.1f %10.2g", cases[c].name, lineCounts[l], snr, diff);
+        if (snr < cases[c].minSnr || diff > cases[c].maxDiff) {
+            printf("  FAIL, expected SNR >= %.0f dB and max diff <= %.0g",
+                   cases[c].minSnr, cases[c].maxDiff);
+            failed = 1;
+        }
+        printf("\n");
+    }
+
+    if (scalar != NULL) pclose(scalar);
+    free(ref);
+    free(out);
+    return failed;
+}
@@ -0,0 +1,113 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Noise floor added by the 16 bit delay line formats. The output of
+   SP_REVSC_HALF and SP_REVSC_INT16 storage is compared with SP_REVSC_FLOAT
+   for 1 second of noise and its tail, at a loud and at a quiet input level.
+   The error is reported as SNR and as its RMS level in dBFS. HALF keeps a
+   relative precision, so its SNR hardly depends on the level. INT16 has a
+   fixed step, so its error level is about the same at any input level and
+   the SNR drops with it. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "soundpipe.h"
+
+#define SRATE   48000
+#define BLOCK   256
+#define SECONDS 3
+
+typedef struct {
+    const char *name;
+    int storage;
+    SPFLOAT level;
+    double minSnr;      /* dB */
+    double maxError;    /* dBFS */
+} storage_case;
+
+static const storage_case cases[] = {
+    { "half",  SP_REVSC_HALF,  0.5,   64,  -78 },
+    { "half",  SP_REVSC_HALF,  0.005, 64, -118 },
+    { "int16", SP_REVSC_INT16, 0.5,   50,  -66 },
+    { "int16", SP_REVSC_INT16, 0.005, 10,  -66 }
+};
+
+static void render(int storage, SPFLOAT level, SPFLOAT *out)
+{
+    static SPFLOAT in[BLOCK];
+    sp_data *sp;
+    sp_revsc *p;
+    uint32_t seed = 1;
+    int b, i;
+
+    sp_create(&sp);
+    sp->sr = SRATE;
+    sp_revsc_create(&p);
+    p->iStorage = storage;
+    sp_revsc_init(sp, p);
+
+    for (b = 0; b < SECONDS * SRATE / BLOCK; b++) {
+        for (i = 0; i < BLOCK; i++) {
+            seed = seed * 1664525 + 1013904223;
+            in[i] = b < SRATE / BLOCK ? ((SPFLOAT) (seed >> 8) / 8388608 - 1) * level : 0;
+        }
+        sp_revsc_compute_block(sp, p, in, in, out + b * BLOCK,
+                               out + (SECONDS * SRATE) + b * BLOCK, BLOCK);
+    }
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(void)
+{
+    const int frames = 2 * SECONDS * SRATE;
+    SPFLOAT *ref = malloc(sizeof(SPFLOAT) * frames);
+    SPFLOAT *out = malloc(sizeof(SPFLOAT) * frames);
+    double sig, err, snr, error;
+    size_t c;
+    int i, failed = 0;
+
+    printf("%-6s %8s %8s %12s\n", "format", "level", "SNR dB", "error dBFS");
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        render(SP_REVSC_FLOAT, cases[c].level, ref);
+        render(cases[c].storage, cases[c].level, out);
+
+        sig = err = 0;
+        for (i = 0; i < frames; i++) {
+            sig += (double) ref[i] * ref[i];
+            err += ((double) out[i] - ref[i]) * ((double) out[i] - ref[i]);
+        }
+        snr = 10 * log10(sig / err);
+        error = 10 * log10(err / frames);
+
+        printf("%-6s %8.3f %8.1f %12.1f", cases[c].name, cases[c].level, snr, error);
+        if (snr < cases[c].minSnr || error > cases[c].maxError) {
+            printf("  FAIL, expected SNR >= %.0f dB and error <= %.0f dBFS",
+                   cases[c].minSnr, cases[c].maxError);
+            failed = 1;
+        }
+        printf("\n");
+    }
+
+    free(ref);
+    free(out);
+    return failed;
+}
@@ -0,0 +1,145 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// RevSC<float> and RevSC<double> against sp_revsc, for every number of lines
+// and interpolation at 44.1 and 48 kHz. Read positions come from revsc.c and
+// are the same, so the difference is the arithmetic alone and the SNR has to
+// stay above the figures below, about 130 dB measured. A single segment that
+// differs brings it below 80 dB. Built with the default flags of this
+// Makefile, -ffast-math included. The input is 1 second of noise and its
+// tail, pitch modulation is halved halfway through it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "RevSC.hpp"
+
+#define BLOCK   256
+#define SECONDS 3
+
+struct TemplateCase
+{
+    const char* name;
+    int         interpolation;
+    double      minSnrFloat;    // dB
+    double      minSnrDouble;   // dB
+};
+
+static const TemplateCase cases[] = {
+    { "none",   SP_REVSC_NONE,   120, 120 },
+    { "linear", SP_REVSC_LINEAR, 120, 120 },
+    { "cubic",  SP_REVSC_CUBIC,  120, 120 }
+};
+
+static const int lineCounts[] = { 4, 8, 16 };
+static const int sampleRates[] = { 44100, 48000 };
+
+static void render_c(int sampleRate, int lines, int interpolation, const std::vector<float>& in,
+                     std::vector<float>& out)
+{
+    const int frames = (int) in.size();
+    std::vector<float> l(in), r(in);
+    sp_data* sp;
+    sp_revsc* p;
+
+    sp_create(&sp);
+    sp->sr = sampleRate;
+    sp_revsc_create(&p);
+    p->iLines = lines;
+    sp_revsc_init(sp, p);
+    p->interpolation = interpolation;
+
+    out.resize(2 * frames);
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        if (i / BLOCK == frames / 2 / BLOCK) p->iPitchMod = 0.5;
+        sp_revsc_compute_block(sp, p, &l[i], &r[i], &out[i], &out[frames + i], n);
+    }
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+template <typename Sample>
+static void render_cpp(int sampleRate, int lines, int interpolation,
+                       const std::vector<float>& in, std::vector<float>& out)
+{
+    const int frames = (int) in.size();
+    RevSC<Sample> rev;
+
+    rev.interpolation = interpolation;
+    rev.init(sampleRate, sampleRate, lines);
+
+    out.resize(2 * frames);
+    for (int i = 0; i < frames; i += BLOCK) {
+        uint32_t n = std::min(BLOCK, frames - i);
+        if (i / BLOCK == frames / 2 / BLOCK) rev.pitchMod = 0.5;
+        rev.process(&in[i], &in[i], &out[i], &out[frames + i], n);
+    }
+}
+
+static double snr(const std::vector<float>& ref, const std::vector<float>& x)
+{
+    double sig = 0, err = 0;
+
+    for (size_t i = 0; i < ref.size(); i++) {
+        sig += (double) ref[i] * ref[i];
+        err += ((double) x[i] - ref[i]) * ((double) x[i] - ref[i]);
+    }
+    return err > 0 ? 10 * std::log10(sig / err) : INFINITY;
+}
+
+int main()
+{
+    std::vector<float> in, outC, outF, outD;
+    bool failed = false;
+
+    printf("%-6s %6s %5s %10s %10s\n", "interp", "rate", "lines", "float SNR", "double SNR");
+
+    for (int sampleRate : sampleRates) {
+        uint32_t seed = 1;
+
+        in.assign(SECONDS * sampleRate, 0.f);
+        for (int i = 0; i < sampleRate; i++) {
+            seed = seed * 1664525 + 1013904223;
+            in[i] = (float) (seed >> 8) / 16777216 - 0.5f;
+        }
+
+        for (const TemplateCase& c : cases)
+        for (int lines : lineCounts) {
+            render_c(sampleRate, lines, c.interpolation, in, outC);
+            render_cpp<float>(sampleRate, lines, c.interpolation, in, outF);
+            render_cpp<double>(sampleRate, lines, c.interpolation, in, outD);
+
+            double f = snr(outC, outF);
+            double d = snr(outC, outD);
+
+            printf("%-6s %6d %5d %10.1f %10.1f", c.name, sampleRate, lines, f, d);
+            if (f < c.minSnrFloat || d < c.minSnrDouble) {
+                printf("  FAIL, expected SNR >= %.0f dB for float and >= %.0f dB for double",
+                       c.minSnrFloat, c.minSnrDouble);
+                failed = true;
+            }
+            printf("\n");
+        }
+    }
+
+    return failed;
+}
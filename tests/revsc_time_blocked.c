@@ -0,0 +1,164 @@
+/*
+ * Castello Reverb
+ * Copyright (C) 2021-2022 Luciano Iam <oss@lucianoiam.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* The time blocked kernels must give the output of the default kernels
+   within rounding, and through sp_revsc.parallel the same output as
+   without it, bit for bit. Every combination of rate, number of lines,
+   storage, interpolation and iPow2Size is run with small blocks and
+   iPitchMod at 1, then with iPitchMod at 0 and blocks of 8192 frames,
+   several times over. Switching to 0 leaves delays below the range of the
+   new modulation depth, which the run length has to allow for. The
+   parallel hook runs the tasks in reverse order on the calling thread. */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "soundpipe.h"
+
+#define SMALL   256
+#define LARGE   8192
+#define CYCLES  8
+#define FRAMES  (CYCLES * (16 * SMALL + 2 * LARGE))
+
+/* Against the default kernels by storage format. The compiler can contract
+   and reorder the same arithmetic differently in each kernel. With the 16 bit
+   formats a sample that rounds the other way then spreads through the
+   feedback, the difference stays within the noise the format adds, see
+   revsc_storage.c. */
+
+typedef struct {
+    const char *name;
+    double minSnr;      /* dB */
+    double maxDiff;
+} tolerance;
+
+static const tolerance tolerances[3] = {
+    { "float", 120, 1e-6 },
+    { "half",   60, 2e-3 },
+    { "int16",  50, 4e-3 }
+};
+
+enum { MODE_TIME_BLOCKED, MODE_PARALLEL, MODES };
+
+static const char *modeNames[MODES] = { "time blocked", "parallel" };
+
+static void reverse_parallel(void *data, sp_revsc_task task, void *arg, int count)
+{
+    int n;
+
+    (void) data;
+    for (n = count - 1; n >= 0; n--) task(arg, n);
+}
+
+static void render(int sr, int lines, int storage, int interpolation, int pow2, int mode,
+                   const SPFLOAT *in, SPFLOAT *out1, SPFLOAT *out2)
+{
+    sp_data *sp;
+    sp_revsc *p;
+    int i = 0, b, c;
+
+    sp_create(&sp);
+    sp->sr = sr;
+    sp_revsc_create(&p);
+    p->iLines = lines;
+    p->iStorage = storage;
+    p->iPow2Size = pow2;
+    p->iParallel = mode == MODE_PARALLEL;
+    sp_revsc_init(sp, p);
+    p->interpolation = interpolation;
+    if (mode >= 0) p->timeBlocked = 1;
+    if (mode == MODE_PARALLEL) p->parallel = reverse_parallel;
+
+    for (c = 0; c < CYCLES; c++) {
+        p->iPitchMod = 1;
+        for (b = 0; b < 16; b++, i += SMALL) {
+            sp_revsc_compute_block(sp, p, (SPFLOAT *) in + i, (SPFLOAT *) in + i,
+                                   out1 + i, out2 + i, SMALL);
+        }
+        p->iPitchMod = 0;
+        for (b = 0; b < 2; b++, i += LARGE) {
+            sp_revsc_compute_block(sp, p, (SPFLOAT *) in + i, (SPFLOAT *) in + i,
+                                   out1 + i, out2 + i, LARGE);
+        }
+    }
+
+    sp_revsc_destroy(&p);
+    sp_destroy(&sp);
+}
+
+int main(void)
+{
+    static const int rates[] = { 44100, 48000 };
+    static const int lineCounts[] = { 4, 8, 16 };
+    static const int interpolations[] = { SP_REVSC_NONE, SP_REVSC_LINEAR, SP_REVSC_CUBIC };
+    static SPFLOAT in[FRAMES], ref1[FRAMES], ref2[FRAMES], tb1[FRAMES], tb2[FRAMES];
+    static SPFLOAT out1[FRAMES], out2[FRAMES];
+    double sig, err, diff, snr, minSnr[3] = { INFINITY, INFINITY, INFINITY }, maxDiff[3] = { 0 };
+    uint32_t seed = 1;
+    int r, l, s, t, pow2, i, configs = 0, failed = 0;
+
+    for (i = 0; i < FRAMES; i++) {
+        seed = seed * 1664525 + 1013904223;
+        in[i] = (SPFLOAT) (seed >> 8) / 16777216 - 0.5;
+    }
+
+    for (r = 0; r < 2; r++)
+    for (l = 0; l < 3; l++)
+    for (s = SP_REVSC_FLOAT; s <= SP_REVSC_INT16; s++)
+    for (t = 0; t < 3; t++)
+    for (pow2 = 0; pow2 < 2; pow2++) {
+        render(rates[r], lineCounts[l], s, interpolations[t], pow2, -1, in, ref1, ref2);
+        render(rates[r], lineCounts[l], s, interpolations[t], pow2, MODE_TIME_BLOCKED,
+               in, tb1, tb2);
+        render(rates[r], lineCounts[l], s, interpolations[t], pow2, MODE_PARALLEL,
+               in, out1, out2);
+        configs++;
+
+        sig = err = diff = 0;
+        for (i = 0; i < FRAMES; i++) {
+            sig += (double) ref1[i] * ref1[i] + (double) ref2[i] * ref2[i];
+            err += ((double) tb1[i] - ref1[i]) * ((double) tb1[i] - ref1[i])
+                   + ((double) tb2[i] - ref2[i]) * ((double) tb2[i] - ref2[i]);
+            if (fabs((double) tb1[i] - ref1[i]) > diff) diff = fabs((double) tb1[i] - ref1[i]);
+            if (fabs((double) tb2[i] - ref2[i]) > diff) diff = fabs((double) tb2[i] - ref2[i]);
+        }
+        snr = err > 0 ? 10 * log10(sig / err) : INFINITY;
+        if (snr < minSnr[s]) minSnr[s] = snr;
+        if (diff > maxDiff[s]) maxDiff[s] = diff;
+
+        if (snr < tolerances[s].minSnr || diff > tolerances[s].maxDiff) {
+            printf("FAIL %s: rate %d, %d lines, storage %d, interpolation %d, pow2 %d, "
+                   "%.1f dB SNR, max diff %.2g\n", modeNames[MODE_TIME_BLOCKED],
+                   rates[r], lineCounts[l], s, interpolations[t], pow2, snr, diff);
+            failed++;
+        } else if (memcmp(tb1, out1, sizeof(tb1)) != 0 || memcmp(tb2, out2, sizeof(tb2)) != 0) {
+            for (i = 0; tb1[i] == out1[i] && tb2[i] == out2[i]; i++) {}
+            printf("FAIL %s: rate %d, %d lines, storage %d, interpolation %d, "
+                   "pow2 %d, first difference at frame %d\n", modeNames[MODE_PARALLEL],
+                   rates[r], lineCounts[l], s, interpolations[t], pow2, i);
+            failed++;
+        }
+    }
+
+    for (s = SP_REVSC_FLOAT; s <= SP_REVSC_INT16; s++) {
+        printf("%s: lowest SNR %.1f dB, max diff %.2g against the default kernels\n",
+               tolerances[s].name, minSnr[s], maxDiff[s]);
+    }
+    printf("%d of %d configurations match\n", configs - failed, configs);
+    return failed != 0;
+}